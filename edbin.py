@@ -0,0 +1,123 @@
+"""Reader for the binary "edbin" record files written by the simulation (see include/records.hpp).
+
+    header, columns = edbin.open_edbin("relaxationData/....bin")
+    columns["r"]  # numpy array backed by the file
+
+load_columns() opens text and binary files alike and returns the same dictionary of columns.
+open_pyramid() opens the levels of a trajectory pyramid (see include/pyramid.hpp) and
+read_kymograph() the state snapshots of a kymograph (see include/kymograph.hpp).
+"""
+import os
+import numpy as np
+
+TEXT_COLUMNS = ["time", "r", "N0", "N1"]
+
+
+def read_header(path, magic=b"EDBIN 1"):
+    """Dictionary of the header fields. Comment lines "# a=1\tb=2" add their key=value pairs too."""
+    with open(path, "rb") as f:
+        first = f.read(4096)
+        if not first.startswith(magic + b"\n"):
+            raise ValueError(path + " is not a " + magic.decode().split()[0].lower() + " file")
+        size = int(first.split(b"\n")[1].split(b"=")[1])
+        raw = first + f.read(size - len(first))
+    header = {}
+    for line in raw[:size].rstrip(b"\0").decode().split("\n")[1:]:
+        fields = line[2:].split("\t") if line.startswith("# ") else [line]
+        for field in fields:
+            key, sep, value = field.partition("=")
+            if sep:
+                header[key] = value
+    return header
+
+
+def open_edbin(path):
+    """(header, columns): the columns map each name to a read-only array of its records."""
+    header = read_header(path)
+    rows = int(header["rows"])
+    block_rows = int(header["blockRows"])
+    names = []
+    dtypes = []
+    for column in header["columns"].split("\t"):
+        name, dtype = column.split(":")
+        names.append(name)
+        dtypes.append((name, dtype, (block_rows,)))
+    blocks = (rows + block_rows - 1) // block_rows
+    columns = {}
+    if blocks:
+        data = np.memmap(path, dtype=np.dtype(dtypes), mode="r",
+                         offset=int(header["headerBytes"]), shape=(blocks,))
+        for name in names:
+            # a single block is mapped without copying, more blocks are gathered into one array
+            column = data[name][0] if blocks == 1 else data[name].reshape(-1)
+            columns[name] = column[:rows]
+    else:
+        for name, dtype, _ in dtypes:
+            columns[name] = np.empty(0, dtype=dtype)
+    return header, columns
+
+
+def load_columns(path):
+    """Columns of a text or binary record file as a dictionary of arrays."""
+    if path.endswith(".bin"):
+        return open_edbin(path)[1]
+    with open(path) as f:
+        f.readline()
+        names = f.readline().lstrip("# ").split()
+    if names == ["dt", "r", "N0", "N1"]:
+        names = TEXT_COLUMNS  # files written before the columns were named after their contents
+    data = np.loadtxt(path, skiprows=2, ndmin=2)
+    return {name: data[:, i] for i, name in enumerate(names)}
+
+
+def read_trailer(path):
+    """Trailer value of a text or binary record file, without loading its records."""
+    if path.endswith(".bin"):
+        return int(open_edbin(path)[1]["time"][-1])
+    with open(path, "rb") as f:
+        f.seek(0, os.SEEK_END)
+        f.seek(max(0, f.tell() - 4096))
+        return int(float(f.read().rstrip(b"\n").split(b"\n")[-1].split(b"\t")[0]))
+
+
+def open_pyramid(directory):
+    """[(header, columns)] of the levels of a pyramid, from the finest to the coarsest."""
+    levels = []
+    while os.path.exists(os.path.join(directory, "level%d.bin" % len(levels))):
+        levels.append(open_edbin(os.path.join(directory, "level%d.bin" % len(levels))))
+    return levels
+
+
+def pyramid_level(levels, bins):
+    """(header, columns) of the finest level of 'levels' with at most 'bins' bins."""
+    for header, columns in levels:
+        if int(header["rows"]) <= bins:
+            return header, columns
+    return levels[-1]
+
+
+def read_kymograph(path, first=0, last=None, step=1):
+    """(header, states): the snapshots first, first + step, ... before last as rows of uint8 states."""
+    header = read_header(path, b"EDKYMO 1")
+    n = int(header["N"])
+    bits = int(header["bitsPerSite"])
+    rows = int(header["rows"])
+    last = rows if last is None else min(last, rows)
+    shifts = np.arange(0, 8, bits, dtype=np.uint8)
+    wanted = range(first, last, step)
+    states = np.empty((len(wanted), n), dtype=np.uint8)
+    with open(path, "rb") as f:
+        f.seek(int(header["headerBytes"]))
+        out = 0
+        for row in range(last):
+            encoding, length = np.frombuffer(f.read(5), dtype=np.dtype([("e", "u1"), ("n", "<u4")]))[0]
+            if row < first or (row - first) % step:
+                f.seek(int(length), os.SEEK_CUR)
+                continue
+            data = np.frombuffer(f.read(int(length)), dtype=np.uint8)
+            if encoding == 1:
+                states[out] = np.repeat(data >> (8 - bits), (data & ((1 << (8 - bits)) - 1)) + 1)
+            else:
+                states[out] = ((data[:, None] >> shifts) & ((1 << bits) - 1)).reshape(-1)[:n]
+            out += 1
+    return header, states
@@ -0,0 +1,100 @@
+#ifndef EVENTLOG_H_INCLUDED
+#define EVENTLOG_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "records.hpp"
+
+// compact log of a trajectory, from which any observable of the states can be recomputed by
+// 'EventReplay' without simulating again. Every event moves one site from state s to s+1 mod Q,
+// so the initial states and the sequence of transitioning sites determine the whole trajectory.
+// "edlog" file layout:
+//     a padded text header (see writePaddedHeader) with the counters 'events' and 'trailer' (the
+//     value given to writeTrailer, e.g. the relaxation period) and the fields N, Q and times
+//     N bytes, the initial states
+//     per event, the zigzag LEB128 varint of the difference to the previous site (at most 3
+//     bytes on lattices of up to 2^20 sites) and, if times=1, the waiting time as a float32
+// waiting times are needed when they are sampled. Mean waiting times could be recomputed from
+// the rates, but the replay keeps no rates, so they are only logged with 'times' as well.
+class EventLogWriter : public TrajectoryRecorder {
+public:
+	// 'states' holds the states of the sites when the logged trajectory starts
+	EventLogWriter(std::ostream&, std::vector<uint8_t> const& states, int Q, bool times, std::string const& header);
+	~EventLogWriter(); // closes
+
+	void record(double time, double dt, int site, const double* values);
+	void writeTrailer(size_t value) { trailer = value; }
+	void flush();
+	// write the buffered events and the counters. Nothing may be recorded afterwards.
+	void close();
+
+	uint64_t numberOfEvents() const { return events; }
+	uint64_t bytes() const { return written + used; }
+
+private:
+	static const size_t CAPACITY = (size_t) 1 << 20;
+	static const size_t MAX_EVENT = 16; // longest varint plus a float32
+
+	std::ostream& out;
+	const bool times;
+	bool closed;
+	std::vector<char> buffer;
+	size_t used;
+	uint64_t written, events, trailer;
+	int previous;
+	std::streampos eventsField, trailerField;
+};
+
+// plays an edlog file back one event at a time. The file is memory mapped and only the states,
+// the populations and the order parameter sums are updated, so replaying is much faster than
+// simulating the trajectory.
+class EventReplay {
+public:
+	explicit EventReplay(std::string const& path);
+	~EventReplay();
+
+	// apply the next event, false at the end of the log
+	bool next()
+	{
+		if (event == events) return false;
+		decode();
+		return true;
+	}
+
+	int getSize() const { return N; }
+	int getNumberOfStates() const { return Q; }
+	bool hasTimes() const { return times; }
+	uint64_t numberOfEvents() const { return events; }
+	uint64_t getTrailer() const { return trailer; }
+	std::string const& getHeader() const { return header; } // the text header, without padding
+
+	uint64_t eventIndex() const { return event; } // events applied so far
+	int site() const { return previous; } // site of the last event
+	double dt() const { return lastDt; } // 0 without times
+	double time() const { return totalTime; }
+	int state(int site) const { return states[site]; }
+	int population(int state) const { return populations[state]; }
+	double orderParameter() const; // same as Lattice::getOrderParameter
+
+private:
+	int N, Q;
+	bool times;
+	uint64_t events, trailer, event;
+	std::string header;
+	const unsigned char* map;
+	size_t mapBytes;
+	const unsigned char* cursor;
+	const unsigned char* end;
+	std::vector<uint8_t> states;
+	std::vector<int> populations;
+	std::vector<double> phaseCos, phaseSin;
+	double cosSum, sinSum, lastDt, totalTime;
+	int previous;
+
+	void decode();
+};
+
+#endif
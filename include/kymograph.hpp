@@ -0,0 +1,58 @@
+#ifndef KYMOGRAPH_H_INCLUDED
+#define KYMOGRAPH_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+#include "records.hpp"
+
+// snapshots of the states of all sites on a grid of physical times 0, interval, 2*interval...,
+// for space-time plots of waves and domains. The recorder keeps its own copy of the states,
+// which every event moves from s to s+1 mod Q, and writes the copy whenever the trajectory
+// passes a grid time.
+// "edkymo" file layout:
+//     a padded text header (see writePaddedHeader) with the counter 'rows' and the fields N, Q,
+//     bitsPerSite, interval and rle
+//     per snapshot, a byte with the row encoding, the uint32 length of the row and the row:
+//         PACKED - the states packed into bitsPerSite (2, 4 or 8) bits, site i in the bits
+//                  (i % sitesPerByte) * bitsPerSite of byte i / sitesPerByte
+//         RUNS   - the runs of equal states, one byte per run with the state in its high
+//                  bitsPerSite bits and the length minus one in the others (longer runs are split)
+//     with 'rle' a row is stored as runs when that is smaller, since states form long domains on
+//     rings; the packed rows are kept for disordered states and for Q > 16.
+// all numbers are little-endian. edbin.py reads the snapshots into numpy arrays.
+class KymographRecords : public TrajectoryRecorder {
+public:
+	enum Encoding { PACKED = 0, RUNS = 1 };
+
+	// 'states' holds the states of the sites when the recorded trajectory starts
+	KymographRecords(std::ostream&, std::vector<uint8_t> const& states, int Q, double interval, bool rle, std::string const& header);
+	~KymographRecords(); // closes
+
+	void record(double time, double dt, int site, const double* values);
+	void writeTrailer(size_t) {}
+	void flush() { out.flush(); }
+	// write the number of rows. Nothing may be recorded afterwards.
+	void close();
+
+	uint64_t numberOfRows() const { return rows; }
+	uint64_t bytes() const { return written; }
+
+private:
+	std::ostream& out;
+	std::vector<uint8_t> states;
+	const int Q, bitsPerSite;
+	const double interval;
+	const bool rle;
+	bool closed;
+	double next; // next grid time
+	uint64_t rows, written;
+	std::vector<uint8_t> packed, runs;
+	std::streampos rowsField;
+
+	void writeRow();
+};
+
+#endif
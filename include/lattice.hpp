@@ -3,16 +3,58 @@
 
 #include <iostream>
 #include <vector>
-#include <random>
+#include <array>
+#include <stdint.h>
 
 #include "pcg_random.hpp"
 #include "topology.hpp"
+#include "random.hpp"
+#include "records.hpp"
+#include "observers.hpp"
 
-class Lattice : public Topology {
+// per-site hot record, the only per-site data touched by the event loop. 'rate' is the index of
+// the site transition rate in the transitions table, which already encodes the site delta (see
+// below), so updating a neighbor reads and writes a single record. Building with
+// -DCOMPACT_LATTICE (make COMPACT=1) packs the record in 4 bytes instead of 8, at the cost of
+// limiting the transitions table to 2^24 entries.
+#ifdef COMPACT_LATTICE
+typedef uint8_t state_t;
+struct Site {
+	uint32_t rate : 24;
+	uint32_t state : 8;
+};
+#else
+typedef short int state_t;
+struct Site {
+	int32_t rate;
+	state_t state;
+};
+#endif
+
+// number of oscillator states Q of the simulated model, set with 'make STATES=Q'. Every state
+// advances to the next one modulo Q, with rate exp(a*(Knext - Ksame)/K) where Knext and Ksame
+// count the neighbors in the next and in the same state. Q=3 is the original model.
+#ifndef NUMBER_OF_STATES
+#define NUMBER_OF_STATES 3
+#endif
+
+template<int Q>
+class BasicLattice : public Topology {
+	static_assert(Q >= 3 && Q <= 64, "the number of states must be between 3 and 64");
 public:
 	// size, k, coupling strength, rewire probability, pcg64 reference for
 	//                                                 a stream of random numbers
-	Lattice(
+	BasicLattice(
+			int const,
+			int const,
+			double const,
+			bool const,
+			double,
+			pcg64&
+			);
+	// same as above for any of the graph families in 'Topology::GraphType'
+	BasicLattice(
+			Topology::GraphType const,
 			int const,
 			int const,
 			double const,
@@ -20,37 +62,139 @@ public:
 			double,
 			pcg64&
 			);
+	// run on an already built topology, e.g. one imported from a file
+	BasicLattice(Topology&&, double, pcg64&);
 
-	double getOrderParameter();
+	// copy of the dynamic state: site records, rate sums, populations and random numbers. The
+	// topology and the transitions table are not part of it, so a snapshot costs a copy of the
+	// per-site arrays and can be restored any number of times into the lattice it was taken from
+	// while its ring is at the same rewire probability, i.e. has the same kernels. Rewiring away
+	// and back may lay the table out again; the rate indexes are then rebased onto the new layout.
+	struct Snapshot {
+		large_vector<Site> sites;
+		large_vector<double> blockRates;
+		std::vector<int> tableOffsets; // layout the rate indexes in 'sites' point into
+		std::array<int, Q> populations;
+		double cosSum, sinSum, totalRate, couplingStrength, rewireProbability, residualTime;
+		RandomBuffer random;
+	};
+	Snapshot snapshot() const;
+	void restore(Snapshot const&);
+	// restore a snapshot and continue it on the counter-based stream (seed, coupling, trial).
+	// Forking many trajectories from one relaxed snapshot replaces their burn-in by a copy.
+	void fork(Snapshot const&, uint64_t seed, uint32_t coupling, uint32_t trial);
+
+	double getOrderParameter() const;
 	int getPop(short int);
+	int getState(int site) const { return sites[site].state; }
 	double step();
+	int getLastEvent() const { return lastEvent; } // site that transitioned in the last 'step'
+
+	// what the observers of 'advance' receive after every event (see observers.hpp)
+	struct Event {
+		int site, oldState, newState;
+		double dt; // time the new state lasts, as returned by 'step'
+		std::array<int, Q> const& populations;
+		BasicLattice const& lattice;
+
+		double orderParameter() const { return lattice.getOrderParameter(); }
+	};
+	// time weighted integrals of the order parameter over a stretch of physical time
+	struct TimeIntegrals {
+		double time, r, r2;
+		size_t events;
+	};
+	// run until 'duration' of physical time has passed. The state reached at the horizon is cut
+	// exactly there and the rest of its waiting time is carried over to the next call, so that
+	// consecutive windows tile the trajectory; 'step' and 'advance' drop that rest.
+	TimeIntegrals advanceUntil(double duration);
+
+	// run 'events' steps, passing each event to all the observers in order
+	template<class... Observers>
+	void advance(size_t events, Observers&... observers)
+	{
+		for(size_t i = 0; i < events; ++i) {
+			double dt = step();
+			int newState = sites[lastEvent].state;
+			Event event = {lastEvent, newState ? newState - 1 : Q - 1, newState, dt, populations, *this};
+			int notify[] = {0, (observers.observe(event), 0)...};
+			(void) notify;
+			(void) event;
+		}
+	}
 	void reset();
 	void resetToCoupling(double);
 	void setCouplingStrength(double);
+	void setRewireProbability(double);
+	// make 'step' return exponentially distributed waiting times instead of their mean
+	void setSampledTimes(bool sampled) { sampledTimes = sampled; }
+	// draw all further random numbers from the counter-based stream (seed, coupling, trial), so
+	// that a trial started with 'reset' after this call can be regenerated on its own
+	void setCounterStream(uint64_t seed, uint32_t coupling, uint32_t trial) { random.setCounterStream(seed, coupling, trial); }
 	void resetTotalRate();
 	void print();
 	void printStates();
 	void printPops();
-	size_t relaxationRun(int trail, double threshold, const size_t MAX_ITERS, std::ofstream& outputFile);
+	void printMemoryPlacement() const; // placement of the kernels, sites and rate arrays
+	size_t relaxationRun(int trail, double threshold, const size_t MAX_ITERS, TrajectoryRecorder& output);
 
 private:
 	const int N; // size and neighbors
-	std::vector<short int> states;
-	std::vector<int> deltas;
-	std::vector<double> transitionRates, transitionsTable;
+	large_vector<Site> sites;
+	std::vector<double> transitionsTable;
+	// the table has one block of 2k+1 rates for each kernel size k present in the topology.
+	// tableOffsets[k] is the start of the block of size k (-1 if absent), so a site with kernel
+	// size k and delta dk has its rate at tableOffsets[k] + k + dk.
+	std::vector<int> kernelSizesPresent, tableOffsets;
+	// sums of the rates of blocks of 2^RATE_BLOCK_BITS consecutive sites, which let 'chooseEvent'
+	// skip whole blocks instead of reading the rate of every site
+	static const int RATE_BLOCK_BITS = 6;
+	large_vector<double> blockRates;
 	double totalRate, couplingStrength;
-	int N0, N1, N2; // populations
-	pcg64& rng;
-	std::uniform_real_distribution<double> uniform;
+	bool sampledTimes;
+	int lastEvent;
+	double residualTime; // waiting time left in the current state after 'advanceUntil'
+	std::array<int, Q> populations;
+	// the order parameter is |sum of exp(2*pi*i*state/Q)|/N. For Q>3 the real and imaginary parts
+	// of the sum are kept up to date on every transition, Q=3 uses a closed form of populations
+	std::array<double, Q> phaseCos, phaseSin;
+	double cosSum, sinSum;
+	// changes of the delta of a transitioning site in state s and of its neighbors, and the
+	// contribution of a neighbor to the delta of a site in state s, all indexed by
+	// (neighbor state - s + Q - 1), which spans every difference of states without a modulo
+	std::array<int, 2*Q - 1> siteChanges, neighborChanges, deltaContributions;
+	RandomBuffer random; // seeded from the pcg64 given at construction
 
+	void initializeStateTables();
 	void initializeStates();
 	void initializeDeltas();
 	void initializeRates();
+	void initializeTableLayout();
 	void calculateTransitionsTable();
 	void transitionSite(int);
 	int chooseEvent();
 	int getSiteDelta(int);
-	int expIndex(int, int);
+	void updatePopulations(state_t, state_t);
+
+	// regular graphs whose kernel size 2K is one of the specialized sizes run 'transitionSite'
+	// and 'getSiteDelta' instantiated for K, with constant trip counts and kernel offsets. The
+	// kernels are selected again whenever the topology changes.
+	void (BasicLattice::*transitionKernel)(int);
+	int (BasicLattice::*deltaKernel)(int);
+	void selectKernels();
+	template<int K> void transitionSiteFixed(int);
+	template<int K> int getSiteDeltaFixed(int);
+
+	// cold per-site data, recovered from the hot record and the kernel size when needed
+	int tableBase(int site) const
+	{
+		int k = Topology::kernelSize(site);
+		return tableOffsets[k] + k;
+	}
+	int siteDelta(int site) const { return (int) sites[site].rate - tableBase(site); }
+	double siteRate(int site) const { return transitionsTable[sites[site].rate]; }
 };
 
+typedef BasicLattice<NUMBER_OF_STATES> Lattice;
+
 #endif
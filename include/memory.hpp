@@ -0,0 +1,71 @@
+#ifndef MEMORY_H_INCLUDED
+#define MEMORY_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <new>
+#include <stddef.h>
+
+// allocation policy for the large topology and lattice arrays:
+// transparentHugePages - madvise(MADV_HUGEPAGE) the arrays so they are backed by 2 MB pages
+// explicitHugePages    - map the arrays from the reserved hugetlbfs pool (MAP_HUGETLB), falling
+//                        back to transparent huge pages when the pool is exhausted
+// placement            - LOCAL leaves pages wherever the kernel first places them, INTERLEAVE
+//                        spreads them round robin over all NUMA nodes and FIRST_TOUCH has the
+//                        'parallelFor' threads touch every page of their own share of the array,
+//                        spreading it over the nodes those (unpinned) threads ran on
+struct MemoryPolicy {
+	enum Placement { LOCAL, INTERLEAVE, FIRST_TOUCH };
+
+	bool transparentHugePages;
+	bool explicitHugePages;
+	Placement placement;
+
+	MemoryPolicy() : transparentHugePages(true), explicitHugePages(false), placement(LOCAL) {}
+};
+
+// parse a comma separated list of "thp", "hugetlb", "interleave", "first-touch" or "none"
+MemoryPolicy parseMemoryPolicy(std::string const&);
+void setMemoryPolicy(MemoryPolicy const&);
+MemoryPolicy const& getMemoryPolicy();
+
+// arrays smaller than this come from the regular heap
+const size_t LARGE_ALLOCATION = (size_t) 2 << 20;
+
+void* allocatePages(size_t);
+void freePages(void*, size_t);
+
+// print the size, huge page coverage and NUMA node distribution of an array
+void printMemoryPlacement(std::string const&, const void*, size_t);
+
+// std::allocator replacement that serves large arrays with 'allocatePages'
+template<class T>
+class PageAllocator {
+public:
+	typedef T value_type;
+
+	PageAllocator() {}
+	template<class U> PageAllocator(PageAllocator<U> const&) {}
+
+	T* allocate(size_t n)
+	{
+		size_t bytes = n * sizeof(T);
+		if (bytes >= LARGE_ALLOCATION) return static_cast<T*>(allocatePages(bytes));
+		return static_cast<T*>(::operator new(bytes));
+	}
+	void deallocate(T* ptr, size_t n)
+	{
+		size_t bytes = n * sizeof(T);
+		if (bytes >= LARGE_ALLOCATION) freePages(ptr, bytes);
+		else ::operator delete(ptr);
+	}
+};
+
+template<class T, class U>
+bool operator==(PageAllocator<T> const&, PageAllocator<U> const&) { return true; }
+template<class T, class U>
+bool operator!=(PageAllocator<T> const&, PageAllocator<U> const&) { return false; }
+
+template<class T> using large_vector = std::vector<T, PageAllocator<T> >;
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef METRICS_H_INCLUDED
+#define METRICS_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <stdint.h>
+
+#include "topology.hpp"
+
+// small-world diagnostics of a topology, computed on its kernels with all available threads
+class GraphMetrics {
+public:
+	// topology, maximum number of BFS sources (all vertices are used if N is not larger)
+	GraphMetrics(Topology const&, size_t const);
+
+	void write(std::ostream&) const; // write the metrics as '#' comment lines
+
+	double averageClustering; // mean of the local clustering coefficients
+	double transitivity; // 3*triangles / connected triples
+	uint64_t triangles;
+	double averagePathLength; // over the reachable pairs from the BFS sources
+	int diameter; // largest distance found from the BFS sources
+	size_t pathSources;
+	uint64_t unreachablePairs;
+	std::vector<uint64_t> degreeHistogram; // number of vertices with each kernel size
+
+private:
+	const int N;
+	large_vector<edge_t> offsets; // sorted copy of the kernels
+	large_vector<vertex_t> neighbors;
+
+	void countTriangles();
+	void measurePaths(size_t const);
+};
+
+#endif
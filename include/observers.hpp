@@ -0,0 +1,105 @@
+#ifndef OBSERVERS_H_INCLUDED
+#define OBSERVERS_H_INCLUDED
+
+#include <vector>
+#include <array>
+#include <math.h>
+#include <stddef.h>
+
+#include "records.hpp"
+
+// measurements for 'BasicLattice::advance'. An observer is any class with a member
+//     template<class Event> void observe(Event const&);
+// called after every event with the event fields site, oldState, newState, dt (the time the new
+// state lasts) and populations, and with orderParameter() computed on request. Observers are
+// template arguments of 'advance', so each loop is compiled with exactly the measurements it
+// takes and an observer that ignores a field costs nothing for it.
+
+// time weighted moments of the order parameter over the observed events
+struct OrderParameterMoments {
+	double time, r, r2;
+
+	OrderParameterMoments() : time(0), r(0), r2(0) {}
+
+	template<class Event>
+	void observe(Event const& e)
+	{
+		double value = e.orderParameter();
+		r += value*e.dt;
+		r2 += value*value*e.dt;
+		time += e.dt;
+	}
+
+	double mean() const { return r / time; }          // <r>
+	double meanSquare() const { return r2 / time; }   // <r^2>
+};
+
+// time weighted means of the populations of the Q states
+template<int Q>
+struct PopulationMeans {
+	double time;
+	std::array<double, Q> sums;
+
+	PopulationMeans() : time(0) { sums.fill(0); }
+
+	template<class Event>
+	void observe(Event const& e)
+	{
+		for (int q = 0; q < Q; ++q) sums[q] += e.populations[q]*e.dt;
+		time += e.dt;
+	}
+
+	double mean(int state) const { return sums[state] / time; }
+};
+
+// passes the events to a TrajectoryRecorder with the state (r, N0, N1, N2) and the accumulated time
+struct TrajectoryObserver {
+	TrajectoryRecorder& output;
+	double time;
+
+	explicit TrajectoryObserver(TrajectoryRecorder& output) : output(output), time(0) {}
+
+	template<class Event>
+	void observe(Event const& e)
+	{
+		time += e.dt;
+		double state[] = {e.orderParameter(), (double) e.populations[0], (double) e.populations[1], (double) e.populations[2]};
+		output.record(time, e.dt, e.site, state);
+	}
+};
+
+// finds the relaxation period of a run: the number of events after which the average order
+// parameter of the last 'blockSize' events has changed by less than 'threshold' per event for
+// more than 'blockSize' consecutive events (0 while not found). The last 'blockSize' values live
+// in a ring buffer whose oldest entry is at 'oldest'.
+struct RelaxationDetector {
+	const int blockSize;
+	const double threshold;
+	std::vector<double> window;
+	size_t oldest, events, relaxationPeriod;
+	int count;
+
+	RelaxationDetector(int blockSize, double threshold)
+		: blockSize(blockSize), threshold(threshold), window(blockSize), oldest(0), events(0),
+		  relaxationPeriod(0), count(0) {}
+
+	template<class Event>
+	void observe(Event const& e)
+	{
+		double r = e.orderParameter();
+		++events;
+		if (events <= (size_t) blockSize) {
+			// the first 'blockSize' events fill the window
+			window[events - 1] = r;
+			return;
+		}
+		double change = (r - window[oldest]) / blockSize;
+		window[oldest] = r;
+		if (++oldest == (size_t) blockSize) oldest = 0;
+		if (fabs(change) < threshold) ++count;
+		else count = 0;
+		if (count > blockSize && relaxationPeriod == 0) relaxationPeriod = events;
+	}
+};
+
+#endif
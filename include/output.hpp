@@ -0,0 +1,71 @@
+#ifndef OUTPUT_H_INCLUDED
+#define OUTPUT_H_INCLUDED
+
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <stdint.h>
+
+// stream buffer that writes a file from a background thread. The simulation thread fills
+// CHUNK-sized buffers and hands each full one over through a single producer single consumer
+// ring of CHUNKS buffers; the writer thread writes them out in order with pwrite. Formatting
+// records never waits for the disk: the producer only blocks (a "stall") when all buffers are
+// waiting to be written, which bounds the memory held by a slow disk.
+//
+// with 'direct' the file is opened with O_DIRECT and full chunks bypass the page cache. Partial
+// chunks are then only written by a seek or at the end, after which O_DIRECT is dropped, since
+// they are not aligned. Without 'direct', a flush (std::flush, std::endl) hands the partial chunk
+// over without waiting for it to be written.
+//
+// seeking waits for all pending chunks to be written. Errors of the writer thread are reported
+// as std::runtime_error by the next hand over or seek.
+class AsyncFileBuffer : public std::streambuf {
+public:
+	static const size_t CHUNK = (size_t) 1 << 20;
+	static const size_t CHUNKS = 8;
+
+	AsyncFileBuffer(std::string const& path, bool direct);
+	~AsyncFileBuffer(); // writes everything and closes the file
+
+	bool is_open() const { return fd >= 0; }
+	size_t stalls() const { return stallCount; }
+
+protected:
+	int_type overflow(int_type);
+	int sync();
+	pos_type seekoff(off_type, std::ios_base::seekdir, std::ios_base::openmode);
+	pos_type seekpos(pos_type, std::ios_base::openmode);
+
+private:
+	struct Chunk {
+		char* data;
+		size_t length;
+		uint64_t offset;
+	};
+
+	std::string path;
+	int fd;
+	bool holdPartialChunks; // O_DIRECT was requested and granted
+	bool direct; // the file still has O_DIRECT, owned by the writer thread once it runs
+	Chunk chunks[CHUNKS];
+	// chunks [tail, head) are waiting for the writer, counters taken modulo CHUNKS
+	std::atomic<size_t> head, tail;
+	std::atomic<bool> stopping;
+	std::atomic<int> error; // errno of a failed write, 0 if none
+	std::mutex mutex; // only used to sleep on the condition variables
+	std::condition_variable ready, freed;
+	std::thread writer;
+	uint64_t position; // file offset of the chunk being filled
+	size_t stallCount;
+
+	void submit(bool partial);
+	void drain();
+	void writerLoop();
+	void writeChunk(Chunk&);
+	void checkErrors();
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef PARALLEL_H_INCLUDED
+#define PARALLEL_H_INCLUDED
+
+#include <thread>
+#include <vector>
+#include <exception>
+#include <algorithm>
+
+// number of worker threads used by the parallel helpers. Can be capped with the
+// NUMBER_OF_THREADS environment variable.
+inline unsigned int numberOfThreads()
+{
+	unsigned int n = std::thread::hardware_concurrency();
+	if (auto tmp = getenv("NUMBER_OF_THREADS")) n = (unsigned int) atoi(tmp);
+	return n ? n : 1;
+}
+
+// split [0, n) in contiguous ranges and call f(thread, begin, end) on each range from its
+// own thread. Exceptions thrown by any of the workers are rethrown on the calling thread.
+template<class F>
+void parallelFor(size_t n, F f)
+{
+	unsigned int threads = (unsigned int) std::min<size_t>(numberOfThreads(), n ? n : 1);
+	if (threads == 1) {
+		f(0u, (size_t) 0, n);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	std::vector<std::exception_ptr> errors(threads);
+	for (unsigned int t = 0; t < threads; ++t) {
+		size_t begin = n * t / threads;
+		size_t end = n * (t + 1) / threads;
+		workers.push_back(std::thread([&f, &errors, t, begin, end]() {
+			try {
+				f(t, begin, end);
+			} catch (...) {
+				errors[t] = std::current_exception();
+			}
+		}));
+	}
+	for (auto& w : workers) w.join();
+	for (auto& e : errors) if (e) std::rethrow_exception(e);
+}
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PYRAMID_H_INCLUDED
+#define PYRAMID_H_INCLUDED
+
+#include <ostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "records.hpp"
+#include "output.hpp"
+
+// multi-resolution summary of a trajectory for plotting it at any zoom level. Level 0 has one
+// bin per 'baseEvents' events and every level above merges pairs of bins of the level below. A
+// bin holds the time its last state ends, its number of events and the minimum, maximum and
+// time weighted mean of r, N0, N1 and N2. Every event updates the bin of level 0 and only
+// completed bins propagate up, so building the pyramid costs O(1) amortized per event.
+//
+// level L is written to the edbin file '<directory>/level<L>.bin' with small blocks, as the
+// levels are created. Level 0 gets as many rows as all the others together, so only it is
+// written from a background thread, through an AsyncFileBuffer opened with 'direct' (see
+// output.hpp); the levels above go through ordinary buffered files. The last partial bin of
+// every level is written by 'close', so all levels cover the whole trajectory. A plot reads
+// the coarsest level with enough bins for its range.
+class PyramidRecords : public TrajectoryRecorder {
+public:
+	static const int MAX_LEVELS = 48;
+	static const size_t LEVEL_BLOCK_ROWS = 1024;
+
+	// 'directory' is created if it doesn't exist. 'header' lines are copied into every level.
+	PyramidRecords(std::string const& directory, size_t baseEvents, std::string const& header,
+	               bool direct);
+	~PyramidRecords(); // closes
+
+	void record(double time, double dt, int site, const double* values);
+	void writeTrailer(size_t) {}
+	void flush();
+	void close();
+
+	int numberOfLevels() const { return (int) levels.size(); }
+
+private:
+	static const int VARIABLES = 4; // r, N0, N1, N2
+
+	struct Bin {
+		double time, events, duration;
+		double minimum[VARIABLES], maximum[VARIABLES], sum[VARIABLES];
+	};
+	struct Level {
+		std::unique_ptr<AsyncFileBuffer> buffer; // level 0 only
+		std::unique_ptr<std::ostream> file;
+		std::unique_ptr<RecordSink> sink;
+		Bin current;
+		int children; // bins (events on level 0) merged into 'current'
+	};
+
+	const std::string directory, header;
+	const size_t baseEvents;
+	const bool direct;
+	bool closed;
+	std::vector<Level> levels;
+	std::vector<RecordColumn> columns;
+
+	void addLevel();
+	void write(Level&);
+	void emit(int level); // write the current bin of 'level' and merge it into the level above
+	static void clear(Bin&);
+	static void merge(Bin&, Bin const&);
+};
+
+#endif
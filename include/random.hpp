@@ -0,0 +1,105 @@
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "pcg_random.hpp"
+
+// uniform double in [0, 1) from the 53 high bits of a 64-bit random number
+inline double uniformFromBits(uint64_t x)
+{
+	return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// integer uniformly distributed in [0, n) with Lemire's nearly divisionless method: the high
+// half of x*n is the result, and the low half only needs the (rare) rejection test with a
+// division when it falls below n. 'rng' is any generator returning 64-bit numbers.
+template<class RNG>
+inline uint64_t boundedRandom(RNG& rng, uint64_t n)
+{
+	__uint128_t m = (__uint128_t) rng() * n;
+	uint64_t low = (uint64_t) m;
+	if (low < n) {
+		uint64_t threshold = -n % n;
+		while (low < threshold) {
+			m = (__uint128_t) rng() * n;
+			low = (uint64_t) m;
+		}
+	}
+	return (uint64_t) (m >> 64);
+}
+
+// tables of the 256 layer ziggurat of the standard exponential distribution (Marsaglia & Tsang,
+// 2000), for 53-bit random integers: layer i accepts r < k[i] directly as x = r*w[i], and f[i] is
+// exp(-x) at the outer edge of layer i
+struct ExponentialZiggurat {
+	static const int LAYERS = 256;
+	uint64_t k[LAYERS];
+	double w[LAYERS], f[LAYERS];
+
+	ExponentialZiggurat();
+};
+extern const ExponentialZiggurat EXPONENTIAL_ZIGGURAT;
+const double ZIGGURAT_EXPONENTIAL_TAIL = 7.69711747013104972; // start of the tail of layer 0
+
+// standard exponential random number. About 99% of the draws take one random number, a table
+// lookup and a multiplication; the rest fall back to an exp or a log.
+template<class RNG>
+inline double exponentialRandom(RNG& rng)
+{
+	const ExponentialZiggurat& z = EXPONENTIAL_ZIGGURAT;
+	for (;;) {
+		uint64_t r = rng() >> 3;
+		int i = (int) (r & 0xff);
+		r >>= 8;
+		double x = r * z.w[i];
+		if (r < z.k[i]) return x;
+		if (i == 0) return ZIGGURAT_EXPONENTIAL_TAIL - log1p(-uniformFromBits(rng()));
+		if ((z.f[i - 1] - z.f[i]) * uniformFromBits(rng()) + z.f[i] < exp(-x)) return x;
+	}
+}
+
+// block buffered random numbers for the event loop. LANES independent pcg32 streams (XSH-RR
+// output on a 64-bit LCG, each lane with its own increment) fill BLOCK 64-bit numbers at a time
+// in a loop the compiler vectorizes across lanes, and the numbers are then served from the
+// buffer, which stays in L1. The sequence is fully determined by the generator used to seed
+// the lanes.
+//
+// In counter mode the buffer is filled by Philox4x32-10 (Salmon et al., 2011) instead: number j
+// of a stream is a pure function of (seed, stream, substream, j), so any stream can be
+// regenerated on its own, by any thread or process, without replaying a shared generator.
+class RandomBuffer {
+public:
+	static const int LANES = 16;
+	static const size_t BLOCK = 512;
+
+	RandomBuffer(); // all-zero lanes, to be seeded or assigned before use
+	explicit RandomBuffer(pcg64&);
+	void seed(pcg64&); // draw new lane states and increments, discarding the buffer
+	// switch to counter mode and restart at the beginning of the given stream
+	void setCounterStream(uint64_t seed, uint32_t stream, uint32_t substream);
+
+	uint64_t operator()()
+	{
+		if (position == BLOCK) refill();
+		return buffer[position++];
+	}
+	double uniform() { return uniformFromBits((*this)()); }
+	uint64_t bounded(uint64_t n) { return boundedRandom(*this, n); }
+	double exponential() { return exponentialRandom(*this); }
+
+private:
+	uint64_t state[LANES], increment[LANES];
+	uint64_t buffer[BLOCK];
+	unsigned int position; // not size_t, which 64-bit stores of the callers could alias
+	bool counterMode;
+	uint64_t counterSeed, counterBlock;
+	uint32_t stream, substream;
+
+	void refill();
+	void refillCounter();
+};
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef RECORDS_H_INCLUDED
+#define RECORDS_H_INCLUDED
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdint.h>
+
+// binary files start with a text header of "key=value" lines padded with zeros to a multiple of
+// 4096 bytes: "<magic>\nheaderBytes=<size>\n", each of 'counters' as "key=<20 digits>\n" and then
+// 'fields'. The counters, such as the number of records, are filled in once known with
+// 'patchHeaderCounter' at the returned stream positions.
+std::vector<std::streampos> writePaddedHeader(std::ostream&, std::string const& magic,
+                                              std::vector<std::string> const& counters, std::string const& fields);
+void patchHeaderCounter(std::ostream&, std::streampos, uint64_t);
+
+// column of a record file, stored as a double ("<f8") or an int32 ("<i4")
+struct RecordColumn {
+	enum Type { FLOAT64, INT32 };
+	std::string name;
+	Type type;
+};
+
+// buffered writer for the records of a run, one value per column. Records are collected in a
+// large buffer that is handed to the stream in big writes, so nothing is flushed per record.
+// Formats:
+// TEXT   - the header lines followed by tab separated lines with 12 decimals for the FLOAT64
+//          columns, as the relaxation files always had
+// BINARY - "edbin" files, read by edbin.py with numpy.memmap. A text header of key=value lines
+//          padded with zeros to a multiple of 4096 bytes:
+//              EDBIN 1
+//              headerBytes=4096
+//              rows=<number of records, 20 digits>
+//              blockRows=65536
+//              columns=time:<f8	r:<f8	N0:<i4	N1:<i4
+//              <the header lines, "# key=value[\tkey=value...]">
+//          (see writePaddedHeader) followed by blocks of blockRows records each stored column
+//          after column, the last block padded with zeros. A block is a fixed size record of one
+//          array per column, so the file maps directly onto a numpy structured dtype.
+class RecordSink {
+public:
+	enum Format { TEXT, BINARY };
+	static const size_t BLOCK_ROWS = 65536;
+
+	// 'header' holds complete '\n' terminated lines. A binary sink needs a seekable stream, the
+	// record count in its header is filled in by 'close'. Sinks of few records can use smaller
+	// binary blocks, which are also the buffer held by the sink.
+	RecordSink(std::ostream&, Format, std::vector<RecordColumn> const&, std::string const& header,
+	           size_t blockRows = BLOCK_ROWS);
+	~RecordSink(); // closes
+
+	static Format formatFromName(std::string const&); // "text" or "binary"
+	static std::string extension(Format); // ".txt" or ".bin"
+
+	size_t numberOfColumns() const { return columns.size(); }
+	// "# name\tname...\n", the line naming the columns in text headers
+	static std::string columnNames(std::vector<RecordColumn> const&);
+
+	void write(const double* values); // one value per column, truncated for INT32 columns
+	// last record of a file, holding a single value such as the relaxation period in its first
+	// column and zeros in the others
+	void writeTrailer(size_t);
+	// hand everything buffered to the stream. Binary sinks keep their incomplete block.
+	void flush();
+	// write the last block and the record count. Nothing may be written afterwards.
+	void close();
+
+private:
+	static const size_t TEXT_CAPACITY = (size_t) 1 << 20;
+	static const size_t MAX_TEXT_VALUE = 40; // %.12f of a double below 1e25, or an int32
+
+	std::ostream& out;
+	const Format format;
+	const std::vector<RecordColumn> columns;
+	bool closed;
+	// TEXT
+	std::vector<char> text;
+	size_t used;
+	// BINARY, one block of blockRows values per column
+	const size_t blockRows;
+	std::vector<std::vector<char> > blocks;
+	size_t blockUsed;
+	uint64_t rows;
+	std::streampos rowsField;
+
+	void writeBlock();
+};
+
+// receives the trajectory of a run one event at a time: the state 'values' (r, N0, N1, ...) is
+// the state left by the transition of 'site', lasting from 'time' - 'dt' to 'time'
+class TrajectoryRecorder {
+public:
+	virtual ~TrajectoryRecorder() {}
+	virtual void record(double time, double dt, int site, const double* values) = 0;
+	// pass a trailer to the sink, see RecordSink::writeTrailer
+	virtual void writeTrailer(size_t) = 0;
+	virtual void flush() = 0;
+};
+
+// one record per event: the time it ends followed by the first values of the state, as many as
+// the sink has columns after the time
+class EventRecords : public TrajectoryRecorder {
+public:
+	explicit EventRecords(RecordSink&);
+	void record(double time, double dt, int site, const double* values);
+	void writeTrailer(size_t value) { sink.writeTrailer(value); }
+	void flush() { sink.flush(); }
+
+private:
+	RecordSink& sink;
+	std::vector<double> row;
+};
+
+// resamples the piecewise constant trajectory on a grid of physical times, so that the output
+// grows with the simulated time instead of the number of events. A record holds the grid time
+// and the state at that time, optionally followed by the time weighted means of the state over
+// the bin that ends at that time. Grids:
+// LINEAR      - times first, 2*first, 3*first, ...
+// LOGARITHMIC - times first*10^(i/perDecade), for i = 0, 1, ...
+// the first bin starts at time 0.
+class TimeGridRecords : public TrajectoryRecorder {
+public:
+	enum Spacing { LINEAR, LOGARITHMIC };
+
+	// the sink has 1 + variables columns, or 1 + 2*variables with 'means'
+	TimeGridRecords(RecordSink&, Spacing, double first, double perDecade, size_t variables, bool means);
+	static Spacing spacingFromName(std::string const&); // "linear" or "log"
+
+	void record(double time, double dt, int site, const double* values);
+	void writeTrailer(size_t value) { sink.writeTrailer(value); }
+	void flush() { sink.flush(); }
+
+private:
+	RecordSink& sink;
+	const Spacing spacing;
+	const double first, ratio;
+	const size_t variables;
+	const bool means;
+	size_t index; // of the next grid time
+	double next, binStart;
+	std::vector<double> sums, row;
+
+	void advance();
+};
+
+// passes the trajectory on to any number of recorders
+class FanOutRecords : public TrajectoryRecorder {
+public:
+	void add(TrajectoryRecorder& recorder) { recorders.push_back(&recorder); }
+	void record(double time, double dt, int site, const double* values)
+	{
+		for (size_t i = 0; i < recorders.size(); ++i) recorders[i]->record(time, dt, site, values);
+	}
+	void writeTrailer(size_t value)
+	{
+		for (size_t i = 0; i < recorders.size(); ++i) recorders[i]->writeTrailer(value);
+	}
+	void flush()
+	{
+		for (size_t i = 0; i < recorders.size(); ++i) recorders[i]->flush();
+	}
+
+private:
+	std::vector<TrajectoryRecorder*> recorders;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef TELEMETRY_H_INCLUDED
+#define TELEMETRY_H_INCLUDED
+
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "records.hpp"
+
+// state of a running simulation published in a POSIX shared memory segment, for viewers that
+// attach to it while it runs (see telemetry.py). The layout is fixed, little-endian and free of
+// padding. 'sequence' is a seqlock: it is odd while the frame is being written, so a reader
+// copies the frame between two reads of an equal, even sequence and retries otherwise.
+//
+// 'history' is a ring of the order parameter at the last HISTORY publications, the most recent
+// one at (historyCount - 1) % HISTORY.
+struct TelemetryFrame {
+	static const int MAX_STATES = 64;
+	static const int HISTORY = 1024;
+
+	char magic[8]; // "EDTEL 1"
+	std::atomic<uint64_t> sequence;
+	uint64_t events; // since the start of the phase
+	uint64_t historyCount;
+	double time; // physical time since the start of the phase
+	double eventsPerSecond;
+	double r;
+	double coupling;
+	int32_t pid, N, Q, phase, couplingIndex, couplings, trial, trials;
+	int32_t populations[MAX_STATES];
+	double history[HISTORY];
+};
+
+// writer of the telemetry segment '/<name>', removed again by the destructor. Publishing copies
+// a few numbers and reads the clock, so the simulation publishes every 'interval' events: the
+// channel is an observer of 'BasicLattice::advance' and a TrajectoryRecorder (with the state r,
+// N0, N1, N2) that only count events in between.
+class TelemetryChannel : public TrajectoryRecorder {
+public:
+	enum Phase { RELAXATION, BURN_IN, MEASUREMENT, FINISHED };
+
+	TelemetryChannel(std::string const& name, int N, int Q, size_t interval);
+	~TelemetryChannel();
+
+	std::string const& getName() const { return name; }
+
+	// start a phase, whose events and time count from zero
+	void setPhase(Phase, int couplingIndex, int couplings, double coupling, int trial, int trials);
+
+	template<class Event>
+	void observe(Event const& e)
+	{
+		time += e.dt;
+		if (++pending < interval) return;
+		int populations[TelemetryFrame::MAX_STATES];
+		for (size_t q = 0; q < e.populations.size(); ++q) populations[q] = e.populations[q];
+		publish(e.orderParameter(), populations, (int) e.populations.size());
+	}
+	// events run without observers, e.g. by 'advanceUntil'
+	template<class Lattice>
+	void add(Lattice& lattice, size_t events, double duration)
+	{
+		time += duration;
+		pending += events;
+		if (pending < interval) return;
+		int populations[TelemetryFrame::MAX_STATES];
+		for (int q = 0; q < Q; ++q) populations[q] = lattice.getPop(q);
+		publish(lattice.getOrderParameter(), populations, Q);
+	}
+
+	void record(double, double dt, int, const double* values);
+	void writeTrailer(size_t) {}
+	void flush() {}
+
+private:
+	const std::string name;
+	const int Q;
+	const size_t interval;
+	TelemetryFrame* frame;
+	size_t pending; // events since the last publication
+	double time;
+	uint64_t events, lastEvents;
+	std::chrono::steady_clock::time_point lastPublished;
+
+	void publish(double r, const int* populations, int states);
+};
+
+#endif
@@ -3,34 +3,114 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <utility>
+#include <unordered_set>
+#include <stdint.h>
 
 #include "pcg_random.hpp"
+#include "memory.hpp"
+
+// index types. vertex_t indexes sites and edge_t indexes kernel entries, i.e. twice the number
+// of edges. Building with -DLARGE_SCALE (make LARGE=1) makes the kernel offsets 64-bit, which
+// is needed once N*2k exceeds 2^31, e.g. for k=100 rings with N in the hundreds of millions.
+typedef int32_t vertex_t;
+#ifdef LARGE_SCALE
+typedef int64_t edge_t;
+#else
+typedef int32_t edge_t;
+#endif
 
 class Topology {
 public:
+	// graph families. All but the lattices are parametrized so that their mean degree is 2k:
+	// RING            - Watts-Strogatz ring with k forward neighbors rewired with probability p
+	// ERDOS_RENYI     - G(N, q) with q = 2k/(N-1)
+	// LATTICE_2D/3D   - periodic hypercubic lattice of side N^(1/d), k neighbors along each direction,
+	//                   so the degree is 2dk (4k and 6k), not 2k: compare with the other families at
+	//                   their k times d
+	// BARABASI_ALBERT - preferential attachment with k edges per new vertex
+	// RANDOM_REGULAR  - uniform-ish random graph where every vertex has exactly 2k neighbors
+	enum GraphType {
+		RING,
+		ERDOS_RENYI,
+		LATTICE_2D,
+		LATTICE_3D,
+		BARABASI_ALBERT,
+		RANDOM_REGULAR,
+		IMPORTED
+	};
+
 	Topology(int const, int const, double const, bool const); // constructor
+	Topology(GraphType const, int const, int const, double const, bool const);
+	// import a graph from a binary CSR file written by 'saveBinary' or from a text edge list
+	explicit Topology(std::string const&);
 
+	int getSize() const { return N; }
 	int getMaxNeighbors() const { return maxNeighbors; }
 	int getMinNeighbors() const { return minNeighbors; }
+	GraphType getGraphType() const { return graphType; }
+
+	static GraphType graphTypeFromName(std::string const&);
+	static std::string graphTypeName(GraphType);
 
 	void printTopology() const; // graphically print connectivity matrix
 	void printKernels() const; // print kernels as lists of indexes
 	void printToFile() const;
+	void saveBinary(std::string const&) const; // write kernels in the binary CSR format
+	void printMemoryPlacement() const; // page size and NUMA placement of the kernels
 
-	std::vector<int> kernelList; // store all kernels sequentially
-	std::vector<int> kernelId; // store an index to the begining of each kernel
-	std::vector<int> kernelSizes; // store all kernel sizes
+	// move a ring to another rewire probability, coupled to the rings at all other probabilities.
+	// Returns the sorted vertices whose kernels changed.
+	std::vector<int> rewireTo(double);
+	double getRewireProbability() const { return p; }
+	void releaseRewiringState();
+
+	large_vector<vertex_t> kernelList; // store all kernels sequentially
+	large_vector<edge_t> kernelId; // store an index to the begining of each kernel, plus the end of the last
+	int kernelSize(int i) const { return (int) (kernelId[i + 1] - kernelId[i]); }
 
 
 private:
+	// kernels of a graph read from a file, before a Topology instance exists
+	struct Kernels {
+		int N;
+		large_vector<vertex_t> kernelList;
+		large_vector<edge_t> kernelId;
+	};
+	explicit Topology(Kernels&&);
+	static Kernels readBinary(std::string const&);
+	static Kernels readEdgeList(std::string const&);
+
+	const GraphType graphType;
 	const int N, k; // size and number of forward neighbors
-	const double p; // reconnection probability
+	double p; // reconnection probability
 	int minNeighbors, maxNeighbors;
 	bool const NON_DETERMINISTIC_TOPOLOGY;
 
+	// rewiring state of rings: the current endpoint of each clockwise edge (i, i+j), stored at
+	// i*k + j-1, the set of edges that are not ring edges and the seed of the per-edge streams
+	large_vector<vertex_t> forwardTarget;
+	std::unordered_set<uint64_t> rewiredEdges;
+	uint64_t rewireSeed;
+
 	void createRing();
+	void resetForwardTargets();
+	void buildRingKernels(std::vector<int> const&);
+	bool isConnected(int, int) const;
+	uint64_t edgeKey(int, int) const;
+	void updateNeighborRange();
+	void createErdosRenyi();
+	void createHypercubic(int);
+	void createBarabasiAlbert();
+	void createRandomRegular();
+	void buildKernels(std::vector<std::pair<int,int> > const&);
+	static void buildKernels(int, std::vector<std::pair<int,int> > const&,
+			large_vector<vertex_t>&, large_vector<edge_t>&);
+	static void checkEntries(uint64_t);
+	static void validateKernels(Kernels&, bool);
+	void seedGenerator(pcg64&) const;
 	void printKernel(int) const;
-	bool isInKernel(int, int) const;
 };
 
 #endif
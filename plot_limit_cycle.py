@@ -2,6 +2,7 @@ import os
 import colorsys
 import numpy as np
 import matplotlib.pyplot as plt
+import edbin
 
 def getColors(N):
     HSV_colors = [((i+1)/N, 0.5, 1.0) for i in range(N)]
@@ -10,7 +11,7 @@ def getColors(N):
 
 dataDir = "relaxationData/"
 allfiles = os.listdir(dataDir)
-datafiles = sorted([f for f in allfiles if ".txt" in f])
+datafiles = sorted([f for f in allfiles if f.endswith(".txt") or f.endswith(".bin")])
 for i,f in enumerate(datafiles): print(i,f)
 indexes = [int(i) for i in input("select files for opening:").split(" ")]
 
@@ -28,9 +29,9 @@ limx = [0, N]
 limy = [N, 0]
 ax.plot(limx,limy, "b-")
 
-data = np.loadtxt(dataDir+filename, skiprows=2)
-p1 = data[:,2][:-1]
-p2 = data[:,3][:-1]
+data = edbin.load_columns(dataDir+filename)
+p1 = data["N0"][:-1]
+p2 = data["N1"][:-1]
 
 ax.plot(p1,p2,"r-")
 
@@ -2,6 +2,7 @@ import os
 import colorsys
 import numpy as np
 import matplotlib.pyplot as plt
+import edbin
 
 def getColors(N):
     HSV_colors = [((i+1)/N, 0.5, 1.0) for i in range(N)]
@@ -10,7 +11,7 @@ def getColors(N):
 
 dataDir = "relaxationData/"
 allfiles = os.listdir(dataDir)
-datafiles = sorted([f for f in allfiles if ".txt" in f])
+datafiles = sorted([f for f in allfiles if f.endswith(".txt") or f.endswith(".bin")])
 for i,f in enumerate(datafiles): print(i,f)
 indexes = [int(i) for i in input("select files for opening:").split(" ")]
 smoothdata = int(input("enter amount of smoothing (0 for none):"));
@@ -23,53 +24,53 @@ ax_pops = [0]*len(indexes)
 for i in range(len(indexes)):
     ax_pops[i] = fig.add_subplot(1+len(indexes),1,2+i, sharex=ax)
 
-for c,idx in enumerate(indexes):
-    data = np.loadtxt(dataDir+datafiles[idx], skiprows=2)
-
-    dt = data[:,0][:-1]
-    r = data[:,1][:-1]
-    n0 = data[:,2][:-1]
-    n1 = data[:,3][:-1]
-    relaxationPeriod = int(data[:,0][-1])
-
-    dtsum = 0
-    for i in range(len(dt)):
-        dtsum += dt[i]
-        dt[i] = dtsum
-
-    if(smoothdata):
-        newdt = np.empty(shape=(0,))
-        newr = np.empty(shape=(0,))
-        newn0 = np.empty(shape=(0,))
-        newn1 = np.empty(shape=(0,))
+def binMeans(x, dt, size):
+    # time weighted means over consecutive bins of 'size' records, dropping the incomplete last
+    # bin. Each record's state lasts 'dt', as in the bin means of the pyramid.
+    n = len(x) // size * size
+    x = np.asarray(x, dtype=float)[:n].reshape(-1, size)
+    dt = np.asarray(dt, dtype=float)[:n].reshape(-1, size)
+    return (x * dt).sum(axis=1) / dt.sum(axis=1)
 
-        newlen = int(len(dt) / smoothdata)
-        for i in range(newlen):
-            j = smoothdata * i
-            window = dt[j : j + smoothdata]
-            newdt = np.append(newdt, np.average(window))
-
-            window = r[j : j + smoothdata]
-            newr = np.append(newr, np.average(window))
-
-            window = n0[j : j + smoothdata]
-            newn0 = np.append(newn0, np.average(window))
+for c,idx in enumerate(indexes):
+    path = dataDir+datafiles[idx]
+    relaxationPeriod = edbin.read_trailer(path)
+    pyramidDir = path[:-4] + ".pyramid"
+    rmin = rmax = None
 
-            window = n1[j : j + smoothdata]
-            newn1 = np.append(newn1, np.average(window))
+    if(smoothdata and os.path.isdir(pyramidDir)):
+        # bins of the pyramid level closest to the smoothing, so the records are never loaded
+        levels = edbin.open_pyramid(pyramidDir)
+        events = int(np.sum(levels[-1][1]["events"]))
+        level = edbin.pyramid_level(levels, max(1, events // smoothdata))[1]
+        x = np.cumsum(level["events"])
+        newr = level["rMean"]
+        rmin = level["rMin"]
+        rmax = level["rMax"]
+        newn0 = level["N0Mean"]
+        newn1 = level["N1Mean"]
     else:
-        newdt = dt
-        newr = r
-        newn0 = n0
-        newn1 = n1
+        data = edbin.load_columns(path)
+        r = data["r"][:-1]
+        n0 = data["N0"][:-1]
+        n1 = data["N1"][:-1]
+        # every record holds the time its state ends
+        dt = np.diff(data["time"][:-1], prepend=0.0)
+        size = max(1, smoothdata)
+        x = (np.arange(len(r) // size) + 1) * size
+        newr = binMeans(r, dt, size)
+        newn0 = binMeans(n0, dt, size)
+        newn1 = binMeans(n1, dt, size)
 
     titleBegin = datafiles[idx].find("a=")
     titleEnd = datafiles[idx].find("TRIAL")
     title = datafiles[idx][titleBegin + 2 : titleEnd]
 
     ax.set_title(title)
-    ax.plot(range(len(newr)), newr, '-', lw=0.8, color=colors[c])
-    ax.axvline(dt[relaxationPeriod])
-    ax_pops[c].plot(range(len(newn0)), newn0, '-', color=colors[c])
-    ax_pops[c].plot(range(len(newn1)), newn1, '-', color=colors[(c+1)%len(colors)])
+    ax.plot(x, newr, '-', lw=0.8, color=colors[c])
+    if(rmin is not None):
+        ax.fill_between(x, rmin, rmax, color=colors[c], alpha=0.3, lw=0)
+    ax.axvline(relaxationPeriod)
+    ax_pops[c].plot(x, newn0, '-', color=colors[c])
+    ax_pops[c].plot(x, newn1, '-', color=colors[(c+1)%len(colors)])
 plt.savefig("foobar.png")
@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "eventlog.hpp"
+
+EventLogWriter::EventLogWriter(std::ostream& out, std::vector<uint8_t> const& states, int Q, bool times, std::string const& header)
+	: out(out), times(times), closed(false), buffer(CAPACITY), used(0), written(0), events(0), trailer(0), previous(0)
+{
+	std::ostringstream fields;
+	fields << "N=" << states.size() << "\n"
+	       << "Q=" << Q << "\n"
+	       << "times=" << (times ? 1 : 0) << "\n"
+	       << header;
+	std::vector<std::string> counters;
+	counters.push_back("events");
+	counters.push_back("trailer");
+	std::vector<std::streampos> positions = writePaddedHeader(out, "EDLOG 1", counters, fields.str());
+	eventsField = positions[0];
+	trailerField = positions[1];
+	out.write(reinterpret_cast<const char*>(states.data()), states.size());
+}
+
+EventLogWriter::~EventLogWriter()
+{
+	close();
+}
+
+void EventLogWriter::record(double, double dt, int site, const double*)
+{
+	if (used + MAX_EVENT > CAPACITY) flush();
+	// zigzag maps the signed difference to 0, -1, 1, -2, 2, ... -> 0, 1, 2, 3, 4, ...
+	int32_t difference = site - previous;
+	uint32_t zigzag = ((uint32_t) difference << 1) ^ (uint32_t) (difference >> 31);
+	previous = site;
+	char* p = &buffer[used];
+	while (zigzag >= 0x80) {
+		*p++ = (char) (zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	*p++ = (char) zigzag;
+	if (times) {
+		float waitingTime = (float) dt;
+		memcpy(p, &waitingTime, sizeof(waitingTime));
+		p += sizeof(waitingTime);
+	}
+	used = p - &buffer[0];
+	++events;
+}
+
+void EventLogWriter::flush()
+{
+	if (used) {
+		out.write(&buffer[0], used);
+		written += used;
+		used = 0;
+	}
+	out.flush();
+}
+
+void EventLogWriter::close()
+{
+	if (closed) return;
+	closed = true;
+	flush();
+	patchHeaderCounter(out, eventsField, events);
+	patchHeaderCounter(out, trailerField, trailer);
+	out.flush();
+}
+
+EventReplay::EventReplay(std::string const& path)
+	: event(0), map(NULL), mapBytes(0), cosSum(0), sinSum(0), lastDt(0), totalTime(0), previous(0)
+{
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) throw std::runtime_error("failed to open event log " + path);
+	struct stat info;
+	fstat(fd, &info);
+	mapBytes = info.st_size;
+	void* data = mapBytes ? mmap(NULL, mapBytes, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (data == MAP_FAILED) throw std::runtime_error("failed to map event log " + path);
+	map = static_cast<const unsigned char*>(data);
+	madvise(data, mapBytes, MADV_SEQUENTIAL);
+
+	// parse the header lines up to the zero padding
+	if (mapBytes < 8 || memcmp(map, "EDLOG 1\n", 8) != 0) throw std::runtime_error(path + " is not an event log");
+	size_t headerBytes = 0;
+	const char* text = reinterpret_cast<const char*>(map);
+	header.assign(text, strnlen(text, std::min<size_t>(mapBytes, 1 << 20)));
+	std::istringstream lines(header);
+	std::string line;
+	N = Q = -1;
+	times = false;
+	events = trailer = 0;
+	while (std::getline(lines, line)) {
+		size_t equals = line.find('=');
+		if (line[0] == '#' || equals == std::string::npos) continue;
+		std::string key = line.substr(0, equals);
+		unsigned long long value = strtoull(line.c_str() + equals + 1, NULL, 10);
+		if (key == "headerBytes") headerBytes = value;
+		else if (key == "events") events = value;
+		else if (key == "trailer") trailer = value;
+		else if (key == "N") N = (int) value;
+		else if (key == "Q") Q = (int) value;
+		else if (key == "times") times = value != 0;
+	}
+	if (N <= 0 || Q < 2 || headerBytes + N > mapBytes) throw std::runtime_error("invalid event log header in " + path);
+
+	states.assign(map + headerBytes, map + headerBytes + N);
+	populations.assign(Q, 0);
+	for (int i = 0; i < N; ++i) {
+		if (states[i] >= Q) throw std::runtime_error("invalid initial state in " + path);
+		++populations[states[i]];
+	}
+	// same sums as the lattice keeps for Q > 3
+	for (int q = 0; q < Q; ++q) {
+		phaseCos.push_back(cos(2*M_PI*q/Q));
+		phaseSin.push_back(sin(2*M_PI*q/Q));
+		cosSum += populations[q]*phaseCos[q];
+		sinSum += populations[q]*phaseSin[q];
+	}
+	cursor = map + headerBytes + N;
+	end = map + mapBytes;
+}
+
+EventReplay::~EventReplay()
+{
+	if (map) munmap(const_cast<unsigned char*>(map), mapBytes);
+}
+
+void EventReplay::decode()
+{
+	uint32_t zigzag = 0;
+	int shift = 0;
+	for (;;) {
+		if (cursor == end) throw std::runtime_error("event log ends before its last event");
+		unsigned char byte = *cursor++;
+		zigzag |= (uint32_t) (byte & 0x7f) << shift;
+		if (!(byte & 0x80)) break;
+		shift += 7;
+	}
+	int32_t difference = (int32_t) (zigzag >> 1) ^ -(int32_t) (zigzag & 1);
+	previous += difference;
+	if (times) {
+		if (end - cursor < (ptrdiff_t) sizeof(float)) throw std::runtime_error("event log ends before its last event");
+		float waitingTime;
+		memcpy(&waitingTime, cursor, sizeof(waitingTime));
+		cursor += sizeof(waitingTime);
+		lastDt = waitingTime;
+		totalTime += lastDt;
+	}
+	if ((unsigned int) previous >= (unsigned int) N) throw std::runtime_error("event log holds an invalid site");
+
+	int oldState = states[previous];
+	int newState = oldState + 1 == Q ? 0 : oldState + 1;
+	states[previous] = (uint8_t) newState;
+	--populations[oldState];
+	++populations[newState];
+	if (Q != 3) {
+		cosSum += phaseCos[newState] - phaseCos[oldState];
+		sinSum += phaseSin[newState] - phaseSin[oldState];
+	}
+	++event;
+}
+
+double EventReplay::orderParameter() const
+{
+	if (Q == 3) {
+		double N0 = populations[0], N1 = populations[1], N2 = populations[2];
+		return sqrt(N0*N0 + N1*N1 + N2*N2 - N1*N2 - N0*N1 - N0*N2)/N;
+	}
+	return sqrt(cosSum*cosSum + sinSum*sinSum)/N;
+}
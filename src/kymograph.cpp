@@ -0,0 +1,100 @@
+#include <string.h>
+#include <sstream>
+#include <stdexcept>
+
+#include "kymograph.hpp"
+
+static int bitsForStates(int Q)
+{
+	return Q <= 4 ? 2 : Q <= 16 ? 4 : 8;
+}
+
+KymographRecords::KymographRecords(std::ostream& out, std::vector<uint8_t> const& states, int Q, double interval, bool rle, std::string const& header)
+	: out(out), states(states), Q(Q), bitsPerSite(bitsForStates(Q)), interval(interval), rle(rle), closed(false),
+	  next(0), rows(0), written(0)
+{
+	if (!(interval > 0)) throw std::runtime_error("the kymograph interval must be positive");
+	size_t sitesPerByte = 8 / bitsPerSite;
+	packed.resize((states.size() + sitesPerByte - 1) / sitesPerByte);
+
+	std::ostringstream fields;
+	fields << "N=" << states.size() << "\n"
+	       << "Q=" << Q << "\n"
+	       << "bitsPerSite=" << bitsPerSite << "\n"
+	       << "interval=" << interval << "\n"
+	       << "rle=" << (rle ? 1 : 0) << "\n"
+	       << header;
+	std::vector<std::string> counters(1, "rows");
+	rowsField = writePaddedHeader(out, "EDKYMO 1", counters, fields.str())[0];
+}
+
+KymographRecords::~KymographRecords()
+{
+	close();
+}
+
+void KymographRecords::record(double time, double, int site, const double*)
+{
+	uint8_t& state = states[site];
+	state = state + 1 == Q ? 0 : state + 1;
+	// the new states hold until 'time', so they are the states at every grid time before it.
+	// Grid times are computed from the row index, as in TimeGridRecords::advance.
+	while (next < time) {
+		writeRow();
+		next = interval * rows;
+	}
+}
+
+void KymographRecords::writeRow()
+{
+	const size_t N = states.size();
+	const uint8_t* data;
+	size_t length;
+	uint8_t encoding = PACKED;
+
+	if (rle && bitsPerSite < 8) {
+		// stops as soon as the runs take more bytes than the packed row
+		const int lengthBits = 8 - bitsPerSite;
+		const size_t longest = (size_t) 1 << lengthBits;
+		runs.clear();
+		for (size_t i = 0; i < N && runs.size() < packed.size();) {
+			size_t end = i + 1;
+			while (end < N && states[end] == states[i] && end - i < longest) ++end;
+			runs.push_back((uint8_t) ((states[i] << lengthBits) | (end - i - 1)));
+			i = end;
+		}
+		if (runs.size() < packed.size()) encoding = RUNS;
+	}
+	if (encoding == RUNS) {
+		data = runs.data();
+		length = runs.size();
+	} else {
+		const int sitesPerByte = 8 / bitsPerSite;
+		for (size_t b = 0; b < packed.size(); ++b) {
+			uint8_t byte = 0;
+			size_t first = b * sitesPerByte;
+			for (int s = 0; s < sitesPerByte && first + s < N; ++s) byte |= states[first + s] << (s * bitsPerSite);
+			packed[b] = byte;
+		}
+		data = packed.data();
+		length = packed.size();
+	}
+
+	uint32_t size = (uint32_t) length;
+	char prefix[5];
+	prefix[0] = (char) encoding;
+	memcpy(prefix + 1, &size, sizeof(size));
+	out.write(prefix, sizeof(prefix));
+	out.write(reinterpret_cast<const char*>(data), length);
+	written += sizeof(prefix) + length;
+	++rows;
+}
+
+void KymographRecords::close()
+{
+	if (closed) return;
+	closed = true;
+	out.flush();
+	patchHeaderCounter(out, rowsField, rows);
+	out.flush();
+}
@@ -1,34 +1,57 @@
 #include <iostream>
-#include <iomanip>
 #include <math.h>
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 
 
 #include "pcg_random.hpp"
 #include "lattice.hpp"
 #include "topology.hpp"
 
-Lattice::Lattice(
+template<int Q>
+BasicLattice<Q>::BasicLattice(
 		int const N,
 		int const k,
 		double const p,
 		bool const USE_DETERMINISTIC_TOPOLOGY,
 		double couplingStrength,
 		pcg64& rng
-		) : Topology(N,k,p,USE_DETERMINISTIC_TOPOLOGY), N(N), rng(rng), uniform(0.0,1.0)
+		) : BasicLattice(Topology::RING, N, k, p, USE_DETERMINISTIC_TOPOLOGY, couplingStrength, rng)
+{
+}
+
+template<int Q>
+BasicLattice<Q>::BasicLattice(
+		Topology::GraphType const graphType,
+		int const N,
+		int const k,
+		double const p,
+		bool const USE_DETERMINISTIC_TOPOLOGY,
+		double couplingStrength,
+		pcg64& rng
+		) : BasicLattice(Topology(graphType,N,k,p,USE_DETERMINISTIC_TOPOLOGY), couplingStrength, rng)
+{
+}
+
+template<int Q>
+BasicLattice<Q>::BasicLattice(
+		Topology&& topology,
+		double couplingStrength,
+		pcg64& rng
+		) : Topology(std::move(topology)), N(Topology::getSize()), random(rng)
 {
 	// set lattice size N, k, and topology at initialization
 	this->couplingStrength = couplingStrength;
 	this->totalRate = 0;
+	this->sampledTimes = false;
+	this->lastEvent = -1;
+	this->residualTime = 0;
 
-	states.resize(N);
-	transitionRates.resize(N);
-	deltas.resize(N);
-	int max = Topology::getMaxNeighbors();
-	int min = Topology::getMinNeighbors();
-	// resize transitions table to accomodate all possible transition values
-	transitionsTable.resize((max + min + 1) * (max - min + 1));
+	sites.resize(N);
+	initializeStateTables();
+	selectKernels();
+	initializeTableLayout();
 
 	initializeStates();
 	calculateTransitionsTable();
@@ -36,313 +59,558 @@ Lattice::Lattice(
 	initializeRates(); // sets rates and totalRate
 }
 
-void Lattice::initializeStates()
+template<int Q>
+void BasicLattice<Q>::initializeTableLayout()
 {
-	// allocate 'states' vector and randomize its entries
-	N0 = N1 = N2 = 0;
-	short int state;
+	// lay out the transitions table with one block per kernel size actually present, so its
+	// size is the sum of (2k+1) over distinct kernel sizes instead of spanning every size
+	// between the minimum and maximum (quadratic in the degree range for scale-free graphs).
+	int max = Topology::getMaxNeighbors();
+	std::vector<char> present(max + 1, 0);
+	for(int i = 0; i < N; ++i) present[Topology::kernelSize(i)] = 1;
+
+	kernelSizesPresent.clear();
+	tableOffsets.assign(max + 1, -1);
+	int size = 0;
+	for(int k = 0; k <= max; ++k) {
+		if(!present[k]) continue;
+		kernelSizesPresent.push_back(k);
+		tableOffsets[k] = size;
+		size += 2*k + 1;
+	}
+#ifdef COMPACT_LATTICE
+	if(size >= (1 << 24)) throw std::runtime_error("transitions table too large for a compact lattice");
+#endif
+	transitionsTable.resize(size);
+}
+
+template<int Q>
+void BasicLattice<Q>::initializeStateTables()
+{
+	for(int d = -(Q - 1); d <= Q - 1; ++d) {
+		// (neighbor state - site state) mod Q
+		int ahead = (d + Q) % Q;
+		int i = d + Q - 1;
+		// a site in state s has delta Knext - Ksame, so moving to s+1 changes it by +1 for each
+		// neighbor in s, -2 for each neighbor in s+1 (from next to same) and +1 for each
+		// neighbor in s+2. Its neighbors in s gain 2, and those in s+1 and s-1 lose 1.
+		deltaContributions[i] = ahead == 0 ? -1 : ahead == 1 ? 1 : 0;
+		siteChanges[i] = ahead == 0 ? 1 : ahead == 1 ? -2 : ahead == 2 ? 1 : 0;
+		neighborChanges[i] = ahead == 0 ? 2 : (ahead == 1 || ahead == Q - 1) ? -1 : 0;
+	}
+	for(int q = 0; q < Q; ++q) {
+		phaseCos[q] = cos(2*M_PI*q/Q);
+		phaseSin[q] = sin(2*M_PI*q/Q);
+	}
+}
+
+template<int Q>
+void BasicLattice<Q>::initializeStates()
+{
+	// randomize the states and count the populations
+	populations.fill(0);
 	for(int i = 0; i < N; ++i) {
-		state = (short int) rng(3);
-		states[i] = state;
-		switch(state) {
-			case 0:
-				++N0;
-				break;
-			case 1:
-				++N1;
-				break;
-			case 2:
-				++N2;
-				break;
-			default:
-				throw std::runtime_error("invalid state value in 'initializeStates'");
-		}
+		state_t state = (state_t) random.bounded(Q);
+		sites[i].state = state;
+		++populations[state];
+	}
+	cosSum = sinSum = 0;
+	for(int q = 0; q < Q; ++q) {
+		cosSum += populations[q]*phaseCos[q];
+		sinSum += populations[q]*phaseSin[q];
 	}
 }
 
-void Lattice::initializeDeltas()
+template<int Q>
+void BasicLattice<Q>::initializeDeltas()
 {
-	// get the delta value for each site and get its transition rate
+	// get the delta value for each site and point it to its transition rate
 	for(int i = 0; i < N; ++i) {
-		deltas[i] = getSiteDelta(i);
+		sites[i].rate = tableBase(i) + (this->*deltaKernel)(i);
 	}
 }
 
-void Lattice::initializeRates()
+template<int Q>
+void BasicLattice<Q>::selectKernels()
 {
+	transitionKernel = &BasicLattice::transitionSite;
+	deltaKernel = &BasicLattice::getSiteDelta;
+	int k = Topology::getMaxNeighbors();
+	if(Topology::getMinNeighbors() != k) return;
+	switch(k) {
+		case 4:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<2>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<2>;
+			break;
+		case 10:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<5>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<5>;
+			break;
+		case 20:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<10>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<10>;
+			break;
+		case 50:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<25>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<25>;
+			break;
+		case 100:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<50>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<50>;
+			break;
+		case 200:
+			transitionKernel = &BasicLattice::template transitionSiteFixed<100>;
+			deltaKernel = &BasicLattice::template getSiteDeltaFixed<100>;
+			break;
+	}
+}
+
+template<int Q>
+void BasicLattice<Q>::initializeRates()
+{
+	// sum the rates of every site and of every block of 2^RATE_BLOCK_BITS consecutive sites
 	totalRate = 0;
+	blockRates.assign(((N - 1) >> RATE_BLOCK_BITS) + 1, 0.0);
 	for(int i = 0; i < N; ++i) {
-		double g = transitionsTable[expIndex(Topology::kernelSizes[i], deltas[i])];
-		transitionRates[i] = g;
+		double g = siteRate(i);
 		totalRate += g;
+		blockRates[i >> RATE_BLOCK_BITS] += g;
 	}
 }
 
-int Lattice::getSiteDelta(int site)
+template<int Q>
+int BasicLattice<Q>::getSiteDelta(int site)
 {
 	int delta = 0;
-	short int currentState = states[site];
-	short int nextState = (currentState+1)%3;
+	const int* contribution = deltaContributions.data() + Q - 1 - sites[site].state;
 
-	int kernelIndex = Topology::kernelId[site];
-	int kernelSize = Topology::kernelSizes[site];
-	for(int i = kernelIndex; i < kernelIndex+kernelSize; ++i) {
+	edge_t kernelIndex = Topology::kernelId[site];
+	edge_t kernelEnd = Topology::kernelId[site+1];
+	for(edge_t i = kernelIndex; i < kernelEnd; ++i) {
+		delta += contribution[sites[Topology::kernelList[i]].state];
+	}
 
-		int neighborSiteIndex = Topology::kernelList[i];
+	return delta;
+}
 
-		short int neighborState = states[neighborSiteIndex];
-		if(neighborState == currentState) --delta;
-		else if(neighborState == nextState) ++delta;
+template<int Q>
+template<int K>
+int BasicLattice<Q>::getSiteDeltaFixed(int site)
+{
+	// every kernel has 2K entries, so the kernel of 'site' starts at 2K*site
+	int delta = 0;
+	const int* contribution = deltaContributions.data() + Q - 1 - sites[site].state;
+	const vertex_t* kernel = Topology::kernelList.data() + (edge_t) 2*K*site;
+	for(int i = 0; i < 2*K; ++i) {
+		delta += contribution[sites[kernel[i]].state];
 	}
 
 	return delta;
 }
 
-int Lattice::chooseEvent()
+template<int Q>
+int BasicLattice<Q>::chooseEvent()
 {
 	// choose a site to suffer a transition proportionally to its transition rate.
 	// an 'event' is the index of the site that suffered a transition
+	// the block sums are scanned first, then the sites of the selected block
 	double partialRate = 0, g = 0;
-	double randomRate = uniform(rng) * totalRate;
-	for(int event = 0; event < N; ++event) {
-		g = transitionRates[event];
-		partialRate += g;
-		if(randomRate < partialRate) return event;
+	double randomRate = random.uniform() * totalRate;
+	int numBlocks = (int) blockRates.size();
+	for(int block = 0; block < numBlocks; ++block) {
+		g = blockRates[block];
+		if(randomRate >= partialRate + g) {
+			partialRate += g;
+			continue;
+		}
+		int first = block << RATE_BLOCK_BITS;
+		int last = std::min(first + (1 << RATE_BLOCK_BITS), N);
+		for(int event = first; event < last; ++event) {
+			partialRate += siteRate(event);
+			if(randomRate < partialRate) return event;
+		}
+		// rounding differences between the block sum and its sites
+		return last - 1;
+	}
+	// 'totalRate' and the block sums drift apart by rounding, so 'randomRate' can fall past the
+	// last block: choose the last site with a nonzero rate
+	for(int block = numBlocks - 1; block >= 0; --block) {
+		if(blockRates[block] <= 0) continue;
+		int first = block << RATE_BLOCK_BITS;
+		for(int event = std::min(first + (1 << RATE_BLOCK_BITS), N) - 1; event >= first; --event) {
+			if(siteRate(event) > 0) return event;
+		}
 	}
 	throw std::runtime_error("no valid event chosen at function 'chooseEvent's end");
 }
 
-void Lattice::transitionSite(int site)
+template<int Q>
+void BasicLattice<Q>::updatePopulations(state_t oldState, state_t newState)
+{
+	--populations[oldState];
+	++populations[newState];
+	if(Q != 3) {
+		cosSum += phaseCos[newState] - phaseCos[oldState];
+		sinSum += phaseSin[newState] - phaseSin[oldState];
+	}
+}
+
+template<int Q>
+void BasicLattice<Q>::transitionSite(int site)
 {
 	// this function is called if 'site' transitioned. Then, update its state, delta and transition rate.
 	// also updates its neighbors deltas and transition rates.
 
 	// update site state and populations
-	short int currentState = states[site];
-	short int newState = (currentState+1)%3;
-	states[site] = newState;
-	switch(newState) {
-		case 0:
-			++N0;
-			--N2;
-			break;
-		case 1: 
-			++N1;
-			--N0;
-			break;
-		case 2:
-			++N2;
-			--N1;
-			break;
-		default:
-			throw std::runtime_error("transitioned to an invalid state while transitioning site");
-	}
+	Site& current = sites[site];
+	state_t currentState = current.state;
+	state_t newState = (currentState + 1) % Q;
+	current.state = newState;
+	updatePopulations(currentState, newState);
 
 	// update neighbors states and all deltas
 	//	the transitioning site has its delta changed a number of times equal to its kernelSize
 	//	each neighbors retains its state and have its delta changed exaclty one time
-	int kernelIndex = Topology::kernelId[site];
-	int kernelSize = Topology::kernelSizes[site];
-	for(int i = kernelIndex; i < kernelIndex+kernelSize; ++i) {
-
-		int neighborSiteIndex = Topology::kernelList[i];
+	//	deltas live in the rate indexes, so changing a delta moves the index by the same amount
+	const int* siteChange = siteChanges.data() + Q - 1 - currentState;
+	const int* neighborChange = neighborChanges.data() + Q - 1 - currentState;
+	double oldSiteRate = transitionsTable[current.rate];
+	int siteDeltaChange = 0;
+	edge_t kernelIndex = Topology::kernelId[site];
+	edge_t kernelEnd = Topology::kernelId[site+1];
+	for(edge_t i = kernelIndex; i < kernelEnd; ++i) {
+
+		Site& neighbor = sites[Topology::kernelList[i]];
+		double oldRate = transitionsTable[neighbor.rate];
+
+		state_t neighborState = neighbor.state;
+		siteDeltaChange += siteChange[neighborState];
+		neighbor.rate += neighborChange[neighborState];
+
+		double newRate = transitionsTable[neighbor.rate];
+		totalRate += newRate;
+		totalRate -= oldRate;
+		blockRates[Topology::kernelList[i] >> RATE_BLOCK_BITS] += newRate - oldRate;
+	}
+	current.rate += siteDeltaChange;
+	double newRate = transitionsTable[current.rate];
+	totalRate += newRate;
+	totalRate -= oldSiteRate;
+	blockRates[site >> RATE_BLOCK_BITS] += newRate - oldSiteRate;
+}
 
-		short int neighborState = states[neighborSiteIndex];
-		if(neighborState == newState) {
-			deltas[site] -= 2;
-			deltas[neighborSiteIndex] -= 1;
-		}
-		else if(neighborState == currentState) {
-			deltas[site] += 1;
-			deltas[neighborSiteIndex] += 2;
-		}
-		else {
-			deltas[site] += 1;
-			deltas[neighborSiteIndex] -= 1;
-		}
-		double newRate = transitionsTable[expIndex(Topology::kernelSizes[neighborSiteIndex], deltas[neighborSiteIndex])];
+template<int Q>
+template<int K>
+void BasicLattice<Q>::transitionSiteFixed(int site)
+{
+	// same as 'transitionSite' for a regular graph with kernels of 2K sites
+	Site& current = sites[site];
+	state_t currentState = current.state;
+	state_t newState = (currentState + 1) % Q;
+	current.state = newState;
+	updatePopulations(currentState, newState);
+
+	const int* siteChange = siteChanges.data() + Q - 1 - currentState;
+	const int* neighborChange = neighborChanges.data() + Q - 1 - currentState;
+	const double* table = transitionsTable.data();
+	double* blocks = blockRates.data();
+	double oldSiteRate = table[current.rate];
+	int siteDeltaChange = 0;
+	const vertex_t* kernel = Topology::kernelList.data() + (edge_t) 2*K*site;
+	for(int i = 0; i < 2*K; ++i) {
+		vertex_t n = kernel[i];
+		Site& neighbor = sites[n];
+		double oldRate = table[neighbor.rate];
+
+		state_t neighborState = neighbor.state;
+		siteDeltaChange += siteChange[neighborState];
+		neighbor.rate += neighborChange[neighborState];
+
+		double newRate = table[neighbor.rate];
 		totalRate += newRate;
-		totalRate -= transitionRates[neighborSiteIndex];
-		transitionRates[neighborSiteIndex] = newRate;
+		totalRate -= oldRate;
+		blocks[n >> RATE_BLOCK_BITS] += newRate - oldRate;
 	}
-	double newRate = transitionsTable[expIndex(Topology::kernelSizes[site], deltas[site])];
+	current.rate += siteDeltaChange;
+	double newRate = table[current.rate];
 	totalRate += newRate;
-	totalRate -= transitionRates[site];
-	transitionRates[site] = newRate;
+	totalRate -= oldSiteRate;
+	blocks[site >> RATE_BLOCK_BITS] += newRate - oldSiteRate;
 }
 
-void Lattice::calculateTransitionsTable()
+template<int Q>
+void BasicLattice<Q>::calculateTransitionsTable()
 {
 	// pre-calculate an exponential table for a particular value of coupling strength 'a'.
-	// if there are too many transitions it might be faster to compute the transition as required.
 	// transition rate: g = exp[a*(Knext - Ksame)/K]
-	// number of possible transitions: (kmax + kmin + 1)*(kmax - kmin + 1)
-	int i = 0;
-	for(int k = Topology::getMinNeighbors(); k < Topology::getMaxNeighbors() + 1; ++k) {
+	// number of possible transitions: sum of (2k + 1) over the kernel sizes k present
+	// isolated sites (k=0, possible in Erdos-Renyi graphs) are uncoupled and transition with g = 1
+	for(size_t j = 0; j < kernelSizesPresent.size(); ++j) {
+		int k = kernelSizesPresent[j];
+		int i = tableOffsets[k];
 		for(int ki = -k; ki <= k; ++ki) {
-			transitionsTable[i] = exp(couplingStrength*ki/k);
+			transitionsTable[i] = k ? exp(couplingStrength*ki/k) : 1.0;
 			++i;
 		}
 	}
 }
 
-int Lattice::expIndex(int k, int dk)
-{
-	// use this function to get the correct value of the exponential for k and dk.
-	// return the one dimensional index with the value of exp(a*dk/k).
-	if(k > Topology::getMaxNeighbors() || k < Topology::getMinNeighbors() || dk > k || dk < -k) {
-		throw std::runtime_error("accessing index out of bounds in expTable");
-	}
-	return (k - Topology::getMinNeighbors()) * (Topology::getMinNeighbors() + k) + (k + dk);
-}
-
-void Lattice::setCouplingStrength(double a)
+template<int Q>
+void BasicLattice<Q>::setCouplingStrength(double a)
 {
 	this->couplingStrength = a;
 	calculateTransitionsTable();
 	initializeRates();
 }
 
-void Lattice::resetTotalRate()
+template<int Q>
+void BasicLattice<Q>::setRewireProbability(double p)
 {
-	totalRate = std::accumulate(transitionRates.begin(), transitionRates.end(), 0.0);
+	// rewire the underlying ring to probability p keeping all states. Only the sites whose
+	// kernels changed get their deltas and rates recomputed, unless a new kernel size appears
+	// and the transitions table has to be laid out again.
+	std::vector<int> affected = Topology::rewireTo(p);
+	if(affected.empty()) return;
+	selectKernels();
+
+	bool newKernelSize = false;
+	for(size_t j = 0; j < affected.size(); ++j) {
+		int k = Topology::kernelSize(affected[j]);
+		if(k >= (int) tableOffsets.size() || tableOffsets[k] < 0) {
+			newKernelSize = true;
+			break;
+		}
+	}
+	if(newKernelSize) {
+		// every rate index moves with the new table layout
+		initializeTableLayout();
+		calculateTransitionsTable();
+		initializeDeltas();
+		initializeRates();
+		return;
+	}
+
+	// the stored rate indexes still point at the old rates of the affected sites
+	for(size_t j = 0; j < affected.size(); ++j) {
+		int site = affected[j];
+		double oldRate = siteRate(site);
+		sites[site].rate = tableBase(site) + (this->*deltaKernel)(site);
+		totalRate += siteRate(site) - oldRate;
+		blockRates[site >> RATE_BLOCK_BITS] += siteRate(site) - oldRate;
+	}
 }
 
-double Lattice::getOrderParameter()
+template<int Q>
+void BasicLattice<Q>::resetTotalRate()
+{
+	initializeRates();
+}
+
+template<int Q>
+double BasicLattice<Q>::getOrderParameter() const
 {
 	// calculate the order parameter for the current state
-	return sqrt((double) N0*N0 + N1*N1 + N2*N2 - N1*N2 - N0*N1 - N0*N2)/N;
+	if(Q == 3) {
+		double N0 = populations[0], N1 = populations[1], N2 = populations[2];
+		return sqrt(N0*N0 + N1*N1 + N2*N2 - N1*N2 - N0*N1 - N0*N2)/N;
+	}
+	return sqrt(cosSum*cosSum + sinSum*sinSum)/N;
 }
 
-double Lattice::step()
+template<int Q>
+double BasicLattice<Q>::step()
 {
 	// this function runs the model dynamics for one step. In the evet driven paradigm this
 	// means that one event will occur for every call of this function, regardless of the time
 	// elapsed.
-	// return value is the expected time this state will last until next transition.
+	// return value is the time this state will last until next transition: its expected value
+	// 1/totalRate, or a sample of the exponential distribution with that mean if 'sampledTimes'.
 	int event = chooseEvent();
-	transitionSite(event);
+	(this->*transitionKernel)(event);
+	lastEvent = event;
+	residualTime = 0;
+	if(sampledTimes) return random.exponential()/totalRate;
 	double expectedTime = 1.0/totalRate;
 
 	return expectedTime;
 }
 
-void Lattice::reset()
+template<int Q>
+void BasicLattice<Q>::reset()
 {
+	residualTime = 0;
 	initializeStates();
 	initializeDeltas();
 	initializeRates();
 }
 
-void Lattice::resetToCoupling(double a)
+template<int Q>
+typename BasicLattice<Q>::Snapshot BasicLattice<Q>::snapshot() const
 {
-	initializeStates();
-	initializeDeltas();
-	setCouplingStrength(a);
+	Snapshot s;
+	s.sites = sites;
+	s.blockRates = blockRates;
+	s.tableOffsets = tableOffsets;
+	s.populations = populations;
+	s.cosSum = cosSum;
+	s.sinSum = sinSum;
+	s.totalRate = totalRate;
+	s.couplingStrength = couplingStrength;
+	s.rewireProbability = Topology::getRewireProbability();
+	s.residualTime = residualTime;
+	s.random = random;
+	return s;
 }
 
-int Lattice::getPop(short int state)
+template<int Q>
+void BasicLattice<Q>::restore(Snapshot const& s)
 {
-	switch(state) {
-		case 0:
-			return N0;
-		case 1:
-			return N1;
-		case 2:
-			return N2;
-		default:
-			throw std::runtime_error("invalid state queried at 'getPop'");
+	// the rate indexes in the site records are only valid for the kernels they were taken with
+	if(s.sites.size() != sites.size() || s.rewireProbability != Topology::getRewireProbability())
+		throw std::runtime_error("snapshot was taken on a different topology");
+	if(s.couplingStrength != couplingStrength) {
+		couplingStrength = s.couplingStrength;
+		calculateTransitionsTable();
 	}
+	// same sizes, so the assignments copy into the existing arrays without reallocating
+	sites = s.sites;
+	if(s.tableOffsets != tableOffsets) {
+		// the table was laid out again since the snapshot: keep every site delta on the new layout
+		for(int i = 0; i < N; ++i) {
+			int k = Topology::kernelSize(i);
+			if(k >= (int) s.tableOffsets.size() || s.tableOffsets[k] < 0)
+				throw std::runtime_error("snapshot was taken on a different topology");
+			sites[i].rate = tableOffsets[k] + (int) sites[i].rate - s.tableOffsets[k];
+		}
+	}
+	blockRates = s.blockRates;
+	populations = s.populations;
+	cosSum = s.cosSum;
+	sinSum = s.sinSum;
+	totalRate = s.totalRate;
+	residualTime = s.residualTime;
+	random = s.random;
 }
 
-size_t Lattice::relaxationRun(int const blockSize, double threshold, size_t const MAX_ITERS, std::ofstream& file)
+template<int Q>
+typename BasicLattice<Q>::TimeIntegrals BasicLattice<Q>::advanceUntil(double duration)
 {
-	// run a single trial to determine relaxation. Relaxation is found when
-	//    the average order parameter doesn't change more than threshold
-	//    for blockSize steps.
-
-	// start by running 'blockSize' steps and storing the 'r' values.
-	std::vector<double> trackR(blockSize);
-	size_t stepCounter = 0;
-	double totalTime = 0;
-	for(int i = 0; i < blockSize; ++i) {
-		++stepCounter;
-		double dt = step();
+	TimeIntegrals integrals = {0, 0, 0, 0};
+	// the state left over from the previous window lasts first
+	double elapsed = std::min(residualTime, duration);
+	if(elapsed > 0) {
 		double r = getOrderParameter();
-		trackR[i] = r;
-		totalTime += dt;
-
-		file << std::fixed << std::setprecision(12)
-		     << totalTime << "\t" << r << "\t" << getPop(0) << "\t" << getPop(1) << std::endl;
+		integrals.r = r*elapsed;
+		integrals.r2 = r*r*elapsed;
+		residualTime -= elapsed;
 	}
-	// get average of the first block of 'blockSize' events
-	double avg = std::accumulate(trackR.begin(), trackR.end(), 0) / trackR.size();
-	double highestAvg = avg;
-	double lowestAvg = avg;
-
-	// for each next step, check if the new average is in an interval of 'threshold'
-	//     around the previous average. If this happens enough consecutive times, break.
-	int count = 0;
-	size_t relaxationPeriod = 0;
-	for(size_t i = blockSize; i < MAX_ITERS; ++i) {
-		++stepCounter;
+	while(elapsed < duration) {
 		double dt = step();
 		double r = getOrderParameter();
-		double nextAvg = avg + (r - trackR[0]) / blockSize;
-		trackR.erase(trackR.begin());
-		trackR.push_back(r);
-		totalTime += dt;
-		if(std::fabs(avg - nextAvg) < threshold) ++count;
-		else count = 0;
-		avg = nextAvg;
-		highestAvg = std::max(highestAvg, avg);
-		lowestAvg = std::min(lowestAvg, avg);
-
-		file << std::fixed << std::setprecision(12)
-		     << totalTime << "\t" << r << "\t" << getPop(0) << "\t" << getPop(1) << std::endl;
-
-		if(count > blockSize && relaxationPeriod == 0) relaxationPeriod = stepCounter;
+		++integrals.events;
+		bool last = elapsed + dt >= duration;
+		if(last) {
+			// cut the last state at the horizon
+			residualTime = elapsed + dt - duration;
+			dt = duration - elapsed;
+		}
+		integrals.r += r*dt;
+		integrals.r2 += r*r*dt;
+		if(last) break;
+		elapsed += dt;
 	}
+	integrals.time = duration;
+	return integrals;
+}
 
+template<int Q>
+void BasicLattice<Q>::fork(Snapshot const& s, uint64_t seed, uint32_t coupling, uint32_t trial)
+{
+	restore(s);
+	random.setCounterStream(seed, coupling, trial);
+}
 
-	if (!relaxationPeriod) {
-		file << MAX_ITERS << "\t0\t0\t0\n";
+template<int Q>
+void BasicLattice<Q>::resetToCoupling(double a)
+{
+	initializeStates();
+	initializeDeltas();
+	setCouplingStrength(a);
+}
+
+template<int Q>
+int BasicLattice<Q>::getPop(short int state)
+{
+	if(state < 0 || state >= Q) throw std::runtime_error("invalid state queried at 'getPop'");
+	return populations[state];
+}
+
+template<int Q>
+size_t BasicLattice<Q>::relaxationRun(int const blockSize, double threshold, size_t const MAX_ITERS, TrajectoryRecorder& output)
+{
+	// run a single trial to determine relaxation. Relaxation is found when
+	//    the average order parameter doesn't change more than threshold
+	//    for blockSize steps (see RelaxationDetector).
+	// every event is passed to 'output' with the state (r, N0, N1, N2) it leaves.
+	RelaxationDetector detector(blockSize, threshold);
+	TrajectoryObserver trajectory(output);
+	advance(std::max(MAX_ITERS, (size_t) blockSize), detector, trajectory);
+
+	if (!detector.relaxationPeriod) {
+		output.writeTrailer(MAX_ITERS);
+		output.flush();
 		std::cout << "Relaxation period expired before converging\n";
 		return MAX_ITERS;
 	}
 	else {
-		file << relaxationPeriod << "\t0\t0\t0\n";
-		return relaxationPeriod;
+		output.writeTrailer(detector.relaxationPeriod);
+		output.flush();
+		return detector.relaxationPeriod;
 	}
 }
 
-void Lattice::print()
+template<int Q>
+void BasicLattice<Q>::print()
 {
 	std::cout << "states: ";
-	for(const auto& s : states) std::cout << s << " ";
+	for(const auto& s : sites) std::cout << (int) s.state << " ";
 	std::cout << std::endl;
 
 	std::cout << "deltas: ";
-	for(const auto& d : deltas) std::cout << d << " ";
+	for(int i = 0; i < N; ++i) std::cout << siteDelta(i) << " ";
 	std::cout << std::endl;
 	
-	std::cout << "populations: " << N0 << " " << N1 << " " << N2 << std::endl;
+	std::cout << "populations:";
+	for(int q = 0; q < Q; ++q) std::cout << " " << populations[q];
+	std::cout << std::endl;
 	std::cout << "min/max neighbors: " << Topology::getMinNeighbors() << "," << Topology::getMaxNeighbors() << std::endl;
 
 	std::cout << "transition rates: ";
 	std::cout.precision(3);
-	for(const auto& g : transitionRates) std::cout << g << " ";
+	for(int i = 0; i < N; ++i) std::cout << siteRate(i) << " ";
 	std::cout << std::endl;
 
 	std::cout << "r = " << getOrderParameter() << std::endl;
 }
 
-void Lattice::printStates()
+template<int Q>
+void BasicLattice<Q>::printStates()
+{
+	for(const auto& s : sites) std::cout << (int) s.state << " ";
+}
+
+template<int Q>
+void BasicLattice<Q>::printPops()
 {
-	for(auto s : states) std::cout << s << " ";
+	for(int q = 0; q < Q; ++q) std::cout << (q ? " " : "") << populations[q];
 }
 
-void Lattice::printPops()
+template<int Q>
+void BasicLattice<Q>::printMemoryPlacement() const
 {
-	std::cout << N0 << " " << N1 << " " << N2;
+	Topology::printMemoryPlacement();
+	::printMemoryPlacement("sites", sites.data(), sites.size()*sizeof(Site));
+	::printMemoryPlacement("blockRates", blockRates.data(), blockRates.size()*sizeof(double));
 }
+
+template class BasicLattice<NUMBER_OF_STATES>;
@@ -4,10 +4,20 @@
 #include <random>
 #include <string>
 #include <sstream>
+#include <memory>
+#include <chrono>
+#include <unistd.h>
 
 #include "pcg_random.hpp"
 #include "topology.hpp"
 #include "lattice.hpp"
+#include "metrics.hpp"
+#include "memory.hpp"
+#include "output.hpp"
+#include "eventlog.hpp"
+#include "pyramid.hpp"
+#include "telemetry.hpp"
+#include "kymograph.hpp"
 
 static int LATTICE_SIZE = 801;
 static int NUMBER_OF_FORWARD_NEIGHBORS = 50;
@@ -19,10 +29,164 @@ static float RELAXATION_COUPLING = 2.59;
 static int RELAXATION_BLOCK_SIZE = 100;
 static float RELAXATION_THRESHOLD = 0.005;
 static int TIMES_TO_RESET = 5;
+static std::string GRAPH_TYPE = "ring";
+static std::string GRAPH_FILE = "";
+static int METRICS_SOURCES = 1024;
+static std::string MEMORY_POLICY = "thp";
+static int SAMPLED_TIMES = 0;
+static int COUNTER_RNG = 0;
+static int FORK_TRIALS = 0;
+static std::string RELAXATION_FORMAT = "text";
+static float SAMPLE_INTERVAL = 0;
+static std::string SAMPLE_SPACING = "linear";
+static float SAMPLES_PER_DECADE = 20;
+static int SAMPLE_MEANS = 0;
+static int OUTPUT_DIRECT = 0;
+static int EVENT_LOG = 0;
+static int EVENT_LOG_TIMES = -1;
+static std::string REPLAY = "";
+static float BURN_IN_TIME = 0;
+static float MEASUREMENT_TIME = 0;
+static int PYRAMID = 0;
+static int PYRAMID_BASE = 16;
+static int TELEMETRY = 0;
+static int TELEMETRY_INTERVAL = 65536;
+static float KYMOGRAPH_INTERVAL = 0;
+static int KYMOGRAPH_RLE = 1;
 
+// the relaxation file holds one record (time, r, N0, N1) per event, or with SAMPLE_INTERVAL > 0
+// the state (r, N0, N1, N2) on a grid of physical times: every SAMPLE_INTERVAL, or from
+// SAMPLE_INTERVAL on with SAMPLES_PER_DECADE log-spaced times per decade if SAMPLE_SPACING=log.
+// SAMPLE_MEANS=1 adds the time averages of the state over each grid bin.
+static size_t relaxationStateColumns()
+{
+	return SAMPLE_INTERVAL > 0 ? 4 : 3;
+}
+
+static std::vector<RecordColumn> relaxationColumns()
+{
+	const char* const stateNames[] = {"r", "N0", "N1", "N2"};
+	std::vector<RecordColumn> columns(1, RecordColumn{"time", RecordColumn::FLOAT64});
+	for(size_t i = 0; i < relaxationStateColumns(); ++i)
+		columns.push_back(RecordColumn{stateNames[i], i ? RecordColumn::INT32 : RecordColumn::FLOAT64});
+	for(size_t i = 0; SAMPLE_INTERVAL > 0 && SAMPLE_MEANS && i < relaxationStateColumns(); ++i)
+		columns.push_back(RecordColumn{std::string(stateNames[i]) + "Mean", RecordColumn::FLOAT64});
+	return columns;
+}
+
+static std::string timeGridHeader()
+{
+	std::ostringstream header;
+	if(SAMPLE_INTERVAL > 0) {
+		header << "# timeGrid=" << SAMPLE_SPACING << "\tsampleInterval=" << SAMPLE_INTERVAL;
+		if(TimeGridRecords::spacingFromName(SAMPLE_SPACING) == TimeGridRecords::LOGARITHMIC)
+			header << "\tsamplesPerDecade=" << SAMPLES_PER_DECADE;
+		header << "\n";
+	}
+	return header.str();
+}
+
+static TrajectoryRecorder* relaxationRecorder(RecordSink& sink)
+{
+	if(SAMPLE_INTERVAL > 0)
+		return new TimeGridRecords(sink, TimeGridRecords::spacingFromName(SAMPLE_SPACING), SAMPLE_INTERVAL,
+		                           SAMPLES_PER_DECADE, relaxationStateColumns(), SAMPLE_MEANS);
+	return new EventRecords(sink);
+}
+
+// recompute the relaxation records of the trajectory in the event log 'path' without simulating
+// it again (see eventlog.hpp). The records go to relaxationData/replay-<log name>, as text or
+// binary and per event or on a time grid like those of a simulation. Logs without waiting
+// times are replayed with the event number as time.
+static int replayEventLog(std::string const& path)
+{
+	EventReplay replay(path);
+	const RecordSink::Format format = RecordSink::formatFromName(RELAXATION_FORMAT);
+	std::string name = path.substr(path.find_last_of('/') + 1);
+	name = "relaxationData/replay-" + name.substr(0, name.find_last_of('.'));
+	std::string filename = name + RecordSink::extension(format);
+	while(std::ifstream(filename)) {
+		name += "+";
+		filename = name + RecordSink::extension(format);
+	}
+	AsyncFileBuffer buffer (filename, OUTPUT_DIRECT);
+	if(!buffer.is_open())
+		throw std::runtime_error("failed to open replay file. Make sure 'relaxationData' folder exists.");
+	std::ostream file (&buffer);
+	file.exceptions(std::ios::badbit);
+
+	// the comment lines of the log header describe the run it came from
+	std::vector<RecordColumn> columns = relaxationColumns();
+	std::ostringstream header;
+	header << "# replay of " << path << "\n"
+	       << RecordSink::columnNames(columns)
+	       << timeGridHeader();
+	std::istringstream logHeader(replay.getHeader());
+	std::string line;
+	while(std::getline(logHeader, line)) {
+		if(!line.empty() && line[0] == '#') header << line << "\n";
+	}
+
+	RecordSink records(file, format, columns, header.str());
+	std::unique_ptr<TrajectoryRecorder> output(relaxationRecorder(records));
+	auto start = std::chrono::steady_clock::now();
+	while(replay.next()) {
+		double state[] = {replay.orderParameter(), (double) replay.population(0),
+		                  (double) replay.population(1), (double) replay.population(2)};
+		double time = replay.hasTimes() ? replay.time() : (double) replay.eventIndex();
+		double dt = replay.hasTimes() ? replay.dt() : 1.0;
+		output->record(time, dt, replay.site(), state);
+	}
+	output->writeTrailer(replay.getTrailer());
+	records.close();
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "replayed " << replay.numberOfEvents() << " events of " << path << " in " << seconds
+	          << " s into " << filename << "\n";
+	return 0;
+}
+
+// run 'events' steps, also publishing them to the telemetry channel when there is one
+template<class... Observers>
+static void advanceObserved(Lattice& simulation, TelemetryChannel* telemetry, size_t events, Observers&... observers)
+{
+	if(telemetry) simulation.advance(events, observers..., *telemetry);
+	else simulation.advance(events, observers...);
+}
+
+static Lattice::TimeIntegrals advanceUntilObserved(Lattice& simulation, TelemetryChannel* telemetry, double duration)
+{
+	Lattice::TimeIntegrals window = simulation.advanceUntil(duration);
+	if(telemetry) telemetry->add(simulation, window.events, window.time);
+	return window;
+}
+
+// file written next to the relaxation file 'relaxationPath', with its extension replaced by
+// 'extension', through a background thread like the relaxation file itself
+struct SideFile {
+	std::unique_ptr<AsyncFileBuffer> buffer;
+	std::unique_ptr<std::ostream> stream;
+};
+
+static SideFile openSideFile(std::string const& relaxationPath, std::string const& extension, std::string const& description)
+{
+	std::string filename = relaxationPath.substr(0, relaxationPath.size()-4) + extension;
+	SideFile file;
+	file.buffer.reset(new AsyncFileBuffer(filename, OUTPUT_DIRECT));
+	if(!file.buffer->is_open()) throw std::runtime_error("failed to open " + description + " " + filename);
+	file.stream.reset(new std::ostream(file.buffer.get()));
+	file.stream->exceptions(std::ios::badbit);
+	return file;
+}
+
+// states of the 'size' sites, as the event log and the kymograph start from them
+static std::vector<uint8_t> currentStates(Lattice const& simulation, int size)
+{
+	std::vector<uint8_t> states(size);
+	for(int i = 0; i < size; ++i) states[i] = (uint8_t) simulation.getState(i);
+	return states;
+}
 
 // TODO:
-// - monitor file changes with python script for real time plotting
 // - write a better README.md using the markdown language
 
 int main(int argc, char *argv[]) {
@@ -36,17 +200,65 @@ int main(int argc, char *argv[]) {
 	if(auto tmp = getenv("RELAXATION_BLOCK_SIZE")) { RELAXATION_BLOCK_SIZE = atoi(tmp); }
 	if(auto tmp = getenv("RELAXATION_THRESHOLD")) { RELAXATION_THRESHOLD = atof(tmp); }
 	if(auto tmp = getenv("TIMES_TO_RESET")) { TIMES_TO_RESET = atoi(tmp); }
+	if(auto tmp = getenv("GRAPH_TYPE")) { GRAPH_TYPE = tmp; }
+	if(auto tmp = getenv("GRAPH_FILE")) { GRAPH_FILE = tmp; }
+	if(auto tmp = getenv("METRICS_SOURCES")) { METRICS_SOURCES = atoi(tmp); }
+	if(auto tmp = getenv("MEMORY_POLICY")) { MEMORY_POLICY = tmp; }
+	if(auto tmp = getenv("SAMPLED_TIMES")) { SAMPLED_TIMES = atoi(tmp); }
+	if(auto tmp = getenv("COUNTER_RNG")) { COUNTER_RNG = atoi(tmp); }
+	if(auto tmp = getenv("FORK_TRIALS")) { FORK_TRIALS = atoi(tmp); }
+	if(auto tmp = getenv("RELAXATION_FORMAT")) { RELAXATION_FORMAT = tmp; }
+	if(auto tmp = getenv("SAMPLE_INTERVAL")) { SAMPLE_INTERVAL = atof(tmp); }
+	if(auto tmp = getenv("SAMPLE_SPACING")) { SAMPLE_SPACING = tmp; }
+	if(auto tmp = getenv("SAMPLES_PER_DECADE")) { SAMPLES_PER_DECADE = atof(tmp); }
+	if(auto tmp = getenv("SAMPLE_MEANS")) { SAMPLE_MEANS = atoi(tmp); }
+	if(auto tmp = getenv("OUTPUT_DIRECT")) { OUTPUT_DIRECT = atoi(tmp); }
+	if(auto tmp = getenv("EVENT_LOG")) { EVENT_LOG = atoi(tmp); }
+	if(auto tmp = getenv("EVENT_LOG_TIMES")) { EVENT_LOG_TIMES = atoi(tmp); }
+	if(auto tmp = getenv("REPLAY")) { REPLAY = tmp; }
+	if(auto tmp = getenv("BURN_IN_TIME")) { BURN_IN_TIME = atof(tmp); }
+	if(auto tmp = getenv("MEASUREMENT_TIME")) { MEASUREMENT_TIME = atof(tmp); }
+	if(auto tmp = getenv("PYRAMID")) { PYRAMID = atoi(tmp); }
+	if(auto tmp = getenv("PYRAMID_BASE")) { PYRAMID_BASE = atoi(tmp); }
+	if(auto tmp = getenv("TELEMETRY")) { TELEMETRY = atoi(tmp); }
+	if(auto tmp = getenv("TELEMETRY_INTERVAL")) { TELEMETRY_INTERVAL = atoi(tmp); }
+	if(auto tmp = getenv("KYMOGRAPH_INTERVAL")) { KYMOGRAPH_INTERVAL = atof(tmp); }
+	if(auto tmp = getenv("KYMOGRAPH_RLE")) { KYMOGRAPH_RLE = atoi(tmp); }
+
+	if(!REPLAY.empty()) return replayEventLog(REPLAY);
+
+	// huge pages and NUMA placement of the large arrays, see memory.hpp
+	setMemoryPolicy(parseMemoryPolicy(MEMORY_POLICY));
 
 	// define lattice parameters:
 	// any changes regarding topology should be done by creating a new lattice instance.
-	const int SIZE = LATTICE_SIZE;
+	// a graph read from GRAPH_FILE overrides the generated graph and its size.
 	const int K = NUMBER_OF_FORWARD_NEIGHBORS;
 	const double REWIRE_PROB = REWIRE_PROBABILITY;
+	const Topology::GraphType GRAPH = GRAPH_FILE.empty() ? Topology::graphTypeFromName(GRAPH_TYPE) : Topology::IMPORTED;
+	Topology topology = GRAPH_FILE.empty()
+		? Topology(GRAPH, LATTICE_SIZE, K, REWIRE_PROB, false)
+		: Topology(GRAPH_FILE);
+	const int SIZE = topology.getSize();
+	// this run never rewires the ring again, so free its per-edge rewiring state
+	if(GRAPH == Topology::RING) topology.releaseRewiringState();
+
+	// small-world diagnostics of the graph, written to the headers of both output files.
+	// path lengths are sampled from METRICS_SOURCES vertices, set it to 0 to skip the metrics.
+	std::ostringstream metricsHeader;
+	if(METRICS_SOURCES > 0) {
+		GraphMetrics metrics(topology, METRICS_SOURCES);
+		metrics.write(metricsHeader);
+		std::cout << metricsHeader.str();
+	}
 	double couplingStrength = RELAXATION_COUPLING;
 
 	// set simulation parameters
 	// maximum amount of iterations in case system takes too long to relax
 	const size_t MAX_ITERS = MAXIMUM_ITERATIONS;
+	// per-event relaxation records are written as text or as binary columns, see records.hpp
+	const RecordSink::Format RELAXATION_RECORDS = RecordSink::formatFromName(RELAXATION_FORMAT);
+	const std::string relaxationExtension = RecordSink::extension(RELAXATION_RECORDS);
 	// number of independent runs for each 'couplingStrength' value
 
 	// paths to data storage folders
@@ -55,40 +267,142 @@ int main(int argc, char *argv[]) {
 
 	// create relaxation&rvsa filenames. If either exists, append a '+' to its name
 	std::ostringstream oss;
-	oss << "relaxation-" << "N=" << SIZE << "k=" << K << "p=" << REWIRE_PROB
-		<< "a=" << couplingStrength << "TRIALS=" << NUMBER_OF_TRIALS << "ITER=" << MAX_ITERS << ".txt";
+	oss << "relaxation-" << "N=" << SIZE << "k=" << K << "p=" << REWIRE_PROB;
+	if(NUMBER_OF_STATES != 3) oss << "Q=" << NUMBER_OF_STATES;
+	if(GRAPH != Topology::RING) oss << "g=" << Topology::graphTypeName(GRAPH);
+	oss	<< "a=" << couplingStrength << "TRIALS=" << NUMBER_OF_TRIALS << "ITER=" << MAX_ITERS << relaxationExtension;
 	std::string relaxationFilename = oss.str();
 	while(std::ifstream(relaxationData + relaxationFilename)) {
-		relaxationFilename = relaxationFilename.substr(0, relaxationFilename.size()-4) + "+.txt";
+		relaxationFilename = relaxationFilename.substr(0, relaxationFilename.size()-4) + "+" + relaxationExtension;
 	}
 	oss.str("");
-	oss << "rvsa-" << "N=" << SIZE << "k=" << K << "p=" << REWIRE_PROB
-		<< "TRIALS=" << NUMBER_OF_TRIALS << "ITER=" << MAX_ITERS << ".txt";
+	oss << "rvsa-" << "N=" << SIZE << "k=" << K << "p=" << REWIRE_PROB;
+	if(NUMBER_OF_STATES != 3) oss << "Q=" << NUMBER_OF_STATES;
+	if(GRAPH != Topology::RING) oss << "g=" << Topology::graphTypeName(GRAPH);
+	oss	<< "TRIALS=" << NUMBER_OF_TRIALS << "ITER=" << MAX_ITERS << ".txt";
 	std::string rvsaFilename = oss.str();
 	while(std::ifstream(rvsaData + rvsaFilename)) {
 		rvsaFilename = rvsaFilename.substr(0, rvsaFilename.size()-4) + "+.txt";
 	}
 
-	// open the new files for writing
-	std::ofstream relaxationFile (relaxationData + relaxationFilename);
-	std::ofstream rvsaFile (rvsaData + rvsaFilename);
-	if(!relaxationFile.is_open())
+	// open the new files for writing. Both are written by background threads (see output.hpp),
+	// with OUTPUT_DIRECT=1 bypassing the page cache.
+	AsyncFileBuffer relaxationBuffer (relaxationData + relaxationFilename, OUTPUT_DIRECT);
+	AsyncFileBuffer rvsaBuffer (rvsaData + rvsaFilename, OUTPUT_DIRECT);
+	if(!relaxationBuffer.is_open())
 		throw std::runtime_error("failed to open relaxation file. Make sure 'relaxationData' folder exists.");
-	if(!rvsaFile.is_open())
+	if(!rvsaBuffer.is_open())
 		throw std::runtime_error("failed to open rvsa file. Make sure 'rvsaData' folder exists.");
+	std::ostream relaxationFile (&relaxationBuffer);
+	std::ostream rvsaFile (&rvsaBuffer);
+	relaxationFile.exceptions(std::ios::badbit);
+	rvsaFile.exceptions(std::ios::badbit);
 
-	// seed rng
-	pcg64 rng(42u, 54u);
-	if(NON_DETERMINISTIC_SEED) rng.seed(pcg_extras::seed_seq_from<std::random_device>());
+	// seed rng. The seed is written to the headers so that any run can be repeated.
+	uint64_t seed = 42u, sequence = 54u;
+	if(NON_DETERMINISTIC_SEED) {
+		std::random_device device;
+		seed = ((uint64_t) device() << 32) | device();
+		sequence = ((uint64_t) device() << 32) | device();
+	}
+	pcg64 rng(seed, sequence);
 
 	// CREATE LATTICE INSTANCE
-	Lattice simulation(SIZE, K, REWIRE_PROB, false, couplingStrength, rng);
+	Lattice simulation(std::move(topology), couplingStrength, rng);
+	simulation.printMemoryPlacement();
+	// waiting times are either their mean 1/totalRate or sampled from the exponential distribution.
+	// The time averages below weight the state left by each event with the time it lasts, so they
+	// are correct in both modes; sampled times are needed for trajectories and first-passage times.
+	simulation.setSampledTimes(SAMPLED_TIMES);
+	std::string runHeader = SAMPLED_TIMES ? "# waitingTimes=sampled\n" : "# waitingTimes=mean\n";
+	{
+		std::ostringstream seedHeader;
+		seedHeader << "# seed=" << seed << "\tsequence=" << sequence << "\n";
+		runHeader += seedHeader.str();
+	}
+
+	// with COUNTER_RNG=1 every trial starts from new random states drawn, like all its events, from
+	// the counter-based stream (counterSeed, coupling index, trial index). Any trial can then be
+	// regenerated exactly from the seed in the headers, independently of the others. The
+	// relaxation run uses the stream of coupling index RELAXATION_STREAM.
+	// with FORK_TRIALS=1 the lattice is relaxed once per coupling strength instead, and every trial
+	// is forked from a snapshot of the relaxed state onto its own counter-based stream, so trials
+	// start decorrelating right away and skip their burn-in.
+	const uint32_t RELAXATION_STREAM = 0xffffffff;
+	const uint64_t counterSeed = COUNTER_RNG || FORK_TRIALS ? rng() : 0;
+	if(COUNTER_RNG || FORK_TRIALS) {
+		std::ostringstream seedHeader;
+		seedHeader << "# counterSeed=" << counterSeed << (FORK_TRIALS ? "\tforkedTrials=1" : "") << "\n";
+		runHeader += seedHeader.str();
+	}
+	if(COUNTER_RNG) {
+		simulation.setCounterStream(counterSeed, RELAXATION_STREAM, 0);
+		simulation.reset();
+	}
 	//simulation.printTopology();
 
 	// relaxation run
-	// write relaxation header
-	relaxationFile << "# data used to determine relaxation period.\n"
-		           << "# dt\tr\tN0\tN1\n";
+	// relaxation header
+	std::vector<RecordColumn> columns = relaxationColumns();
+	std::ostringstream parameters;
+	parameters << "# N=" << SIZE << "\tk=" << K << "\tp=" << REWIRE_PROB << "\tQ=" << NUMBER_OF_STATES
+	           << "\tgraph=" << Topology::graphTypeName(GRAPH) << "\ta=" << couplingStrength
+	           << "\tblockSize=" << RELAXATION_BLOCK_SIZE << "\tthreshold=" << RELAXATION_THRESHOLD << "\n"
+	           << runHeader
+	           << metricsHeader.str();
+	std::ostringstream relaxationHeader;
+	relaxationHeader << "# data used to determine relaxation period.\n"
+	                 << RecordSink::columnNames(columns)
+	                 << timeGridHeader()
+	                 << parameters.str();
+	RecordSink relaxationRecords(relaxationFile, RELAXATION_RECORDS, columns, relaxationHeader.str());
+	std::unique_ptr<TrajectoryRecorder> relaxationOutput(relaxationRecorder(relaxationRecords));
+
+	// with EVENT_LOG=1 the relaxation run is also logged to relaxationData/<relaxation name>.log,
+	// from which REPLAY=<log> recomputes its records (see eventlog.hpp). Waiting times are logged
+	// when they are sampled, or with EVENT_LOG_TIMES=1.
+	SideFile eventLogFile;
+	std::unique_ptr<EventLogWriter> eventLog;
+	FanOutRecords trajectoryOutput;
+	trajectoryOutput.add(*relaxationOutput);
+	if(EVENT_LOG) {
+		eventLogFile = openSideFile(relaxationData + relaxationFilename, ".log", "event log");
+		bool logTimes = EVENT_LOG_TIMES < 0 ? SAMPLED_TIMES : EVENT_LOG_TIMES;
+		eventLog.reset(new EventLogWriter(*eventLogFile.stream, currentStates(simulation, SIZE), NUMBER_OF_STATES, logTimes, parameters.str()));
+		trajectoryOutput.add(*eventLog);
+	}
+
+	// with KYMOGRAPH_INTERVAL > 0 the states of all sites during the relaxation run are written to
+	// relaxationData/<relaxation name>.kymo every KYMOGRAPH_INTERVAL of physical time, as runs of
+	// equal states where that is smaller unless KYMOGRAPH_RLE=0 (see kymograph.hpp)
+	SideFile kymographFile;
+	std::unique_ptr<KymographRecords> kymograph;
+	if(KYMOGRAPH_INTERVAL > 0) {
+		kymographFile = openSideFile(relaxationData + relaxationFilename, ".kymo", "kymograph");
+		kymograph.reset(new KymographRecords(*kymographFile.stream, currentStates(simulation, SIZE), NUMBER_OF_STATES, KYMOGRAPH_INTERVAL, KYMOGRAPH_RLE, parameters.str()));
+		trajectoryOutput.add(*kymograph);
+	}
+
+	// with TELEMETRY=1 the run publishes its state every TELEMETRY_INTERVAL events in the shared
+	// memory segment /dev/shm/event-driven-<pid>, which telemetry.py shows while it runs
+	std::unique_ptr<TelemetryChannel> telemetry;
+	if(TELEMETRY) {
+		std::ostringstream name;
+		name << "event-driven-" << getpid();
+		telemetry.reset(new TelemetryChannel(name.str(), SIZE, NUMBER_OF_STATES, TELEMETRY_INTERVAL));
+		telemetry->setPhase(TelemetryChannel::RELAXATION, -1, 0, couplingStrength, -1, 0);
+		trajectoryOutput.add(*telemetry);
+		std::cout << "publishing telemetry in /dev/shm/" << telemetry->getName() << "\n";
+	}
+
+	// with PYRAMID=1 the relaxation run is also summarized in relaxationData/<relaxation name>.pyramid/,
+	// with levels of bins of PYRAMID_BASE, 2*PYRAMID_BASE, 4*PYRAMID_BASE... events (see pyramid.hpp)
+	std::unique_ptr<PyramidRecords> pyramid;
+	if(PYRAMID) {
+		std::string pyramidDirectory = relaxationData + relaxationFilename.substr(0, relaxationFilename.size()-4) + ".pyramid";
+		pyramid.reset(new PyramidRecords(pyramidDirectory, PYRAMID_BASE, parameters.str(), OUTPUT_DIRECT));
+		trajectoryOutput.add(*pyramid);
+	}
 
 	// FIXME: This function might not be the best solution to detecting relaxation.
 	//  This function gets the average of the order parameter for a block of 'trail' events. The next block
@@ -103,11 +417,32 @@ int main(int argc, char *argv[]) {
 			RELAXATION_BLOCK_SIZE,
 			RELAXATION_THRESHOLD,
 			2*MAX_ITERS,
-			relaxationFile
+			trajectoryOutput
 			);
+	relaxationRecords.close();
+	if(eventLog) {
+		eventLog->close();
+		std::cout << "logged " << eventLog->numberOfEvents() << " events in " << eventLog->bytes() << " bytes\n";
+	}
+	if(kymograph) {
+		kymograph->close();
+		std::cout << "wrote " << kymograph->numberOfRows() << " state snapshots in " << kymograph->bytes() << " bytes\n";
+	}
+	if(pyramid) {
+		pyramid->close();
+		std::cout << "summarized the relaxation run in " << pyramid->numberOfLevels() << " pyramid levels\n";
+	}
 	size_t pointsAfterRelaxation = MAX_ITERS;
 	std::cout << "Relaxation returned " << relaxationPeriod << " iterations for relaxation period.\n";
-	std::cout << "Proceeding to burn " << relaxationPeriod << " steps and record " << pointsAfterRelaxation;
+	// trials burn in and measure for a number of events by default, or for a span of physical time
+	// with BURN_IN_TIME and MEASUREMENT_TIME, so that every coupling strength of the sweep is
+	// measured over the same time whatever its event rate
+	std::ostringstream burnIn, measurement;
+	if(BURN_IN_TIME > 0) burnIn << "a time of " << BURN_IN_TIME;
+	else burnIn << relaxationPeriod << " steps";
+	if(MEASUREMENT_TIME > 0) measurement << "a time of " << MEASUREMENT_TIME;
+	else measurement << pointsAfterRelaxation << " steps";
+	std::cout << "Proceeding to burn " << burnIn.str() << " and record " << measurement.str();
 	std::cout << " for " << NUMBER_OF_TRIALS << " trials.\n";
 
 	// r vs a run
@@ -119,8 +454,13 @@ int main(int argc, char *argv[]) {
 
 	// write rvsa header (order parameter r vs coupling strength a)
 	rvsaFile << "# TRIALS=" << NUMBER_OF_TRIALS << "\trelaxationPeriod=" << relaxationPeriod
-	         << "\tpointsAfterRelaxation=" << pointsAfterRelaxation << std::endl
-			 << "# a" << "\t<<r>>" << "\tX=<<r2>>-<<r>>2\tX'=<<r>2>-<<r>>2\n";
+	         << "\tpointsAfterRelaxation=" << pointsAfterRelaxation;
+	if(BURN_IN_TIME > 0) rvsaFile << "\tburnInTime=" << BURN_IN_TIME;
+	if(MEASUREMENT_TIME > 0) rvsaFile << "\tmeasurementTime=" << MEASUREMENT_TIME;
+	rvsaFile << std::endl
+			 << "# a" << "\t<<r>>" << "\tX=<<r2>>-<<r>>2\tX'=<<r>2>-<<r>>2\n"
+			 << runHeader
+			 << metricsHeader.str();
 
 	// TODO: isolate trial-run into it's own function in lattice.cpp (to simplify the nested loops)
 
@@ -132,30 +472,53 @@ int main(int argc, char *argv[]) {
 		double rAvgSum = 0;
 		double r2AvgSum = 0;
 		double rAvg2Sum = 0;
+		Lattice::Snapshot relaxed;
+		if(FORK_TRIALS) {
+			if(telemetry) telemetry->setPhase(TelemetryChannel::BURN_IN, a, numPoints, aRange[a], -1, NUMBER_OF_TRIALS);
+			if(BURN_IN_TIME > 0) advanceUntilObserved(simulation, telemetry.get(), BURN_IN_TIME);
+			else advanceObserved(simulation, telemetry.get(), relaxationPeriod);
+			relaxed = simulation.snapshot();
+		}
 		for(size_t j = 0; j < NUMBER_OF_TRIALS; ++j) { // run trials for each coupling strength
-			double rSum = 0;
-			double r2Sum = 0;
-			double dtSum = 0;
-
-			// discard the first 'relaxationPeriod' steps
-			for (size_t i = 0; i < relaxationPeriod; ++i) simulation.step();
+			if(FORK_TRIALS) {
+				simulation.fork(relaxed, counterSeed, (uint32_t) a, (uint32_t) j);
+			} else {
+				if(COUNTER_RNG) {
+					simulation.setCounterStream(counterSeed, (uint32_t) a, (uint32_t) j);
+					simulation.reset();
+				}
+				// discard the first 'relaxationPeriod' steps
+				if(telemetry) telemetry->setPhase(TelemetryChannel::BURN_IN, a, numPoints, aRange[a], j, NUMBER_OF_TRIALS);
+				if(BURN_IN_TIME > 0) advanceUntilObserved(simulation, telemetry.get(), BURN_IN_TIME);
+				else advanceObserved(simulation, telemetry.get(), relaxationPeriod);
+			}
+			if(telemetry) telemetry->setPhase(TelemetryChannel::MEASUREMENT, a, numPoints, aRange[a], j, NUMBER_OF_TRIALS);
 
 			// record data after relaxation period and for pointsAfterRelaxation
 			// here we break up the loop in smaller chunks in order to refresh
 			// the total rate and avoid numerical errors
-			size_t chunkSize = pointsAfterRelaxation/TIMES_TO_RESET;
-			for(size_t i = 0; i < TIMES_TO_RESET; ++i) {
-				for (size_t j = 0; j < chunkSize; ++j) {
-					double dt = simulation.step();
-					double r = simulation.getOrderParameter();
-					rSum += r*dt;
-					r2Sum += r*r*dt;
-					dtSum += dt;
+			double rAvg, r2Avg;
+			if(MEASUREMENT_TIME > 0) {
+				double rIntegral = 0, r2Integral = 0, time = 0;
+				for(int i = 0; i < TIMES_TO_RESET; ++i) {
+					Lattice::TimeIntegrals window = advanceUntilObserved(simulation, telemetry.get(), MEASUREMENT_TIME / TIMES_TO_RESET);
+					rIntegral += window.r;
+					r2Integral += window.r2;
+					time += window.time;
+					simulation.resetTotalRate();
+				}
+				rAvg = rIntegral / time;
+				r2Avg = r2Integral / time;
+			} else {
+				OrderParameterMoments moments;
+				size_t chunkSize = pointsAfterRelaxation/TIMES_TO_RESET;
+				for(size_t i = 0; i < TIMES_TO_RESET; ++i) {
+					advanceObserved(simulation, telemetry.get(), chunkSize, moments);
+					simulation.resetTotalRate();
 				}
-				simulation.resetTotalRate();
+				rAvg = moments.mean();
+				r2Avg = moments.meanSquare();
 			}
-			double rAvg = rSum / dtSum;
-			double r2Avg = r2Sum / dtSum;
 
 			rAvgSum += rAvg;
 			r2AvgSum += r2Avg;
@@ -173,6 +536,8 @@ int main(int argc, char *argv[]) {
 		rvsaFile << std::fixed << std::setprecision(12)
 		         << aRange[a] << "\t" << rAvgAvg << "\t" << X << "\t" << Xnew << std::endl;
 	}
+	if(size_t stalls = relaxationBuffer.stalls() + rvsaBuffer.stalls())
+		std::cout << "output waited " << stalls << " times for the disk\n";
 
 	return 0;
 }
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "memory.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+const size_t HUGE_PAGE_SIZE = (size_t) 2 << 20;
+const int MPOL_INTERLEAVE_MODE = 3; // MPOL_INTERLEAVE from <numaif.h>
+
+MemoryPolicy policy;
+
+size_t roundToHugePages(size_t bytes)
+{
+	return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+}
+
+int numberOfNodes()
+{
+	// count /sys/devices/system/node/nodeX entries, 1 if the directory is not available
+	static int nodes = -1;
+	if (nodes > 0) return nodes;
+	nodes = 0;
+	if (DIR* dir = opendir("/sys/devices/system/node")) {
+		while (struct dirent* entry = readdir(dir)) {
+			if (strncmp(entry->d_name, "node", 4) == 0 && entry->d_name[4] >= '0' && entry->d_name[4] <= '9') ++nodes;
+		}
+		closedir(dir);
+	}
+	if (nodes < 1) nodes = 1;
+	return nodes;
+}
+
+}
+
+MemoryPolicy parseMemoryPolicy(std::string const& description)
+{
+	MemoryPolicy parsed;
+	parsed.transparentHugePages = false;
+	std::istringstream tokens(description);
+	std::string token;
+	while (std::getline(tokens, token, ',')) {
+		if (token == "thp") parsed.transparentHugePages = true;
+		else if (token == "hugetlb") parsed.explicitHugePages = true;
+		else if (token == "interleave") parsed.placement = MemoryPolicy::INTERLEAVE;
+		else if (token == "first-touch") parsed.placement = MemoryPolicy::FIRST_TOUCH;
+		else if (token != "none" && !token.empty()) throw std::runtime_error("unknown memory policy '" + token + "'");
+	}
+	return parsed;
+}
+
+void setMemoryPolicy(MemoryPolicy const& newPolicy)
+{
+	policy = newPolicy;
+}
+
+MemoryPolicy const& getMemoryPolicy()
+{
+	return policy;
+}
+
+void* allocatePages(size_t bytes)
+{
+	// anonymous mappings rounded up to whole huge pages. MAP_NORESERVE lets arrays larger than
+	// the free memory be mapped and paged in lazily, as long as they are not fully touched.
+	size_t length = roundToHugePages(bytes);
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+	void* ptr = MAP_FAILED;
+	if (policy.explicitHugePages) {
+		// reserved up front: a MAP_NORESERVE hugetlb mapping succeeds on an empty pool and
+		// then raises SIGBUS on first touch
+		ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		static bool warned = false;
+		if (ptr == MAP_FAILED && !warned) {
+			std::cout << "hugetlb pool exhausted, falling back to transparent huge pages\n";
+			warned = true;
+		}
+	}
+	if (ptr == MAP_FAILED) {
+		ptr = mmap(NULL, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+		if (ptr == MAP_FAILED) throw std::bad_alloc();
+		if (policy.transparentHugePages || policy.explicitHugePages) madvise(ptr, length, MADV_HUGEPAGE);
+	}
+
+	int nodes = numberOfNodes();
+	if (policy.placement == MemoryPolicy::INTERLEAVE && nodes > 1) {
+		std::vector<unsigned long> mask((nodes + 8*sizeof(unsigned long) - 1) / (8*sizeof(unsigned long)), 0);
+		for (int n = 0; n < nodes; ++n) mask[n / (8*sizeof(unsigned long))] |= 1UL << (n % (8*sizeof(unsigned long)));
+		syscall(SYS_mbind, ptr, length, MPOL_INTERLEAVE_MODE, mask.data(), (unsigned long) nodes + 1, 0);
+	} else if (policy.placement == MemoryPolicy::FIRST_TOUCH) {
+		// contiguous shares of the array are touched by the 'parallelFor' threads, so each
+		// share is placed on the node its thread ran on. Every base page is touched: without
+		// huge pages a single write per 2 MB would leave the rest to be placed by the thread
+		// that later value-initializes the array. The threads are not pinned, so this spreads
+		// the array over the nodes but does not tie a share to the engine thread that uses it
+		char* bytesPtr = static_cast<char*>(ptr);
+		const size_t PAGE = (size_t) sysconf(_SC_PAGESIZE);
+		size_t pages = length / PAGE;
+		parallelFor(pages, [bytesPtr, PAGE](unsigned int, size_t first, size_t last) {
+			for (size_t page = first; page < last; ++page) bytesPtr[page * PAGE] = 0;
+		});
+	}
+	return ptr;
+}
+
+void freePages(void* ptr, size_t bytes)
+{
+	munmap(ptr, roundToHugePages(bytes));
+}
+
+void printMemoryPlacement(std::string const& name, const void* ptr, size_t bytes)
+{
+	if (!ptr || !bytes) return;
+	uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+
+	// huge page coverage of the mapping holding the array, from /proc/self/smaps
+	long hugeKB = -1, kernelPageKB = -1;
+	std::ifstream smaps("/proc/self/smaps");
+	std::string line;
+	bool inMapping = false;
+	while (std::getline(smaps, line)) {
+		unsigned long begin, end;
+		char dash;
+		std::istringstream fields(line);
+		if (line.find(':') == std::string::npos || line.find('-') < line.find(':')) {
+			if (fields >> std::hex >> begin >> dash >> end && dash == '-') {
+				if (inMapping) break;
+				inMapping = address >= begin && address < end;
+				continue;
+			}
+		}
+		if (!inMapping) continue;
+		if (line.compare(0, 14, "AnonHugePages:") == 0) hugeKB = atol(line.c_str() + 14);
+		else if (line.compare(0, 15, "KernelPageSize:") == 0) kernelPageKB = atol(line.c_str() + 15);
+	}
+
+	// NUMA node of a sample of the pages, queried with move_pages without moving them
+	const size_t PAGE = (size_t) sysconf(_SC_PAGESIZE);
+	size_t pages = (bytes + PAGE - 1) / PAGE;
+	size_t samples = std::min<size_t>(pages, 4096);
+	std::vector<void*> addresses(samples);
+	std::vector<int> status(samples, -1);
+	for (size_t i = 0; i < samples; ++i)
+		addresses[i] = reinterpret_cast<void*>((address + (pages * i / samples) * PAGE) / PAGE * PAGE);
+	std::map<int, size_t> perNode;
+	if (syscall(SYS_move_pages, 0, samples, addresses.data(), NULL, status.data(), 0) == 0) {
+		for (size_t i = 0; i < samples; ++i) ++perNode[status[i]];
+	}
+
+	// formatted apart, so that the fixed precision doesn't stick to std::cout
+	std::ostringstream summary;
+	summary << "memory " << name << ": " << std::fixed << std::setprecision(1) << bytes / 1048576.0 << " MB";
+	if (kernelPageKB > 4) summary << ", hugetlb pages of " << kernelPageKB << " kB";
+	else if (hugeKB >= 0) summary << ", mapping has " << hugeKB / 1024.0 << " MB in huge pages";
+	if (!perNode.empty()) {
+		summary << ", nodes";
+		for (std::map<int, size_t>::const_iterator it = perNode.begin(); it != perNode.end(); ++it) {
+			double percentage = 100.0 * it->second / samples;
+			if (it->first >= 0) summary << " " << it->first << ":" << percentage << "%";
+			else summary << " untouched:" << percentage << "%";
+		}
+	}
+	std::cout << summary.str() << "\n";
+}
@@ -0,0 +1,168 @@
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <random>
+
+#include "pcg_random.hpp"
+#include "metrics.hpp"
+#include "parallel.hpp"
+
+GraphMetrics::GraphMetrics(Topology const& topology, size_t const maxSources) : N(topology.getSize())
+{
+	// copy the kernels and sort each of them, which both the triangle counting (sorted
+	// intersections) and the BFS work on
+	offsets = topology.kernelId;
+	neighbors = topology.kernelList;
+	parallelFor(N, [&](unsigned int, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i)
+			std::sort(neighbors.begin() + offsets[i], neighbors.begin() + offsets[i + 1]);
+	});
+
+	degreeHistogram.assign(topology.getMaxNeighbors() + 1, 0);
+	for (int i = 0; i < N; ++i) ++degreeHistogram[topology.kernelSize(i)];
+
+	countTriangles();
+	measurePaths(maxSources);
+}
+
+void GraphMetrics::countTriangles()
+{
+	// every triangle v < u < w is found exactly once, from v, by intersecting the parts of the
+	// kernels of v and u above u. Each thread keeps its own per-vertex counts for the local
+	// clustering, which are summed at the end.
+	unsigned int threads = numberOfThreads();
+	std::vector<std::vector<uint32_t> > local(threads);
+	parallelFor(N, [&](unsigned int t, size_t first, size_t last) {
+		std::vector<uint32_t>& count = local[t];
+		count.assign(N, 0);
+		const vertex_t* kernels = neighbors.data();
+		for (size_t v = first; v < last; ++v) {
+			const vertex_t* vEnd = kernels + offsets[v + 1];
+			const vertex_t* uIt = std::upper_bound(kernels + offsets[v], vEnd, (vertex_t) v);
+			for (; uIt != vEnd; ++uIt) {
+				int u = *uIt;
+				const vertex_t* a = uIt + 1;
+				const vertex_t* bEnd = kernels + offsets[u + 1];
+				const vertex_t* b = std::upper_bound(kernels + offsets[u], bEnd, u);
+				while (a != vEnd && b != bEnd) {
+					if (*a < *b) ++a;
+					else if (*b < *a) ++b;
+					else {
+						++count[v];
+						++count[u];
+						++count[*a];
+						++a;
+						++b;
+					}
+				}
+			}
+		}
+	});
+
+	std::vector<uint64_t> perVertex(N, 0);
+	for (unsigned int t = 0; t < threads; ++t) {
+		if (local[t].empty()) continue;
+		for (int v = 0; v < N; ++v) perVertex[v] += local[t][v];
+	}
+
+	triangles = std::accumulate(perVertex.begin(), perVertex.end(), (uint64_t) 0) / 3;
+	double clusteringSum = 0, triples = 0;
+	for (int v = 0; v < N; ++v) {
+		double d = offsets[v + 1] - offsets[v];
+		double pairs = d*(d - 1)/2;
+		triples += pairs;
+		if (pairs > 0) clusteringSum += perVertex[v] / pairs;
+	}
+	averageClustering = clusteringSum / N;
+	transitivity = triples > 0 ? 3.0*triangles / triples : 0.0;
+}
+
+void GraphMetrics::measurePaths(size_t const maxSources)
+{
+	// bit-parallel BFS: 64 sources are explored at once, bit b of visited[v] telling whether v
+	// was reached from source b. A vertex is expanded once per level for all sources whose
+	// frontier it belongs to. Batches of 64 sources are spread over the threads.
+	std::vector<int> sources(N);
+	std::iota(sources.begin(), sources.end(), 0);
+	if ((size_t) N > maxSources) {
+		pcg64 rng(42u, 54u);
+		for (size_t i = 0; i < maxSources; ++i) std::swap(sources[i], sources[i + rng(N - i)]);
+		sources.resize(maxSources);
+	}
+	pathSources = sources.size();
+	size_t batches = (sources.size() + 63) / 64;
+
+	unsigned int threads = numberOfThreads();
+	std::vector<uint64_t> distanceSum(threads, 0), reached(threads, 0);
+	std::vector<int> maxDistance(threads, 0);
+	parallelFor(batches, [&](unsigned int t, size_t first, size_t last) {
+		std::vector<uint64_t> visited(N), frontier(N, 0), next(N, 0);
+		std::vector<int> frontierList, nextList;
+		for (size_t batch = first; batch < last; ++batch) {
+			std::fill(visited.begin(), visited.end(), 0);
+			frontierList.clear();
+			size_t begin = 64*batch;
+			size_t end = std::min(begin + 64, sources.size());
+			for (size_t s = begin; s < end; ++s) {
+				int v = sources[s];
+				uint64_t bit = (uint64_t) 1 << (s - begin);
+				if (!frontier[v]) frontierList.push_back(v);
+				frontier[v] |= bit;
+				visited[v] |= bit;
+			}
+
+			int level = 0;
+			while (!frontierList.empty()) {
+				++level;
+				nextList.clear();
+				for (size_t j = 0; j < frontierList.size(); ++j) {
+					int v = frontierList[j];
+					uint64_t f = frontier[v];
+					frontier[v] = 0;
+					for (edge_t i = offsets[v]; i < offsets[v + 1]; ++i) {
+						int n = neighbors[i];
+						uint64_t bits = f & ~visited[n];
+						if (!bits) continue;
+						if (!next[n]) nextList.push_back(n);
+						next[n] |= bits;
+					}
+				}
+				for (size_t j = 0; j < nextList.size(); ++j) {
+					int n = nextList[j];
+					uint64_t bits = next[n];
+					next[n] = 0;
+					visited[n] |= bits;
+					frontier[n] = bits;
+					uint64_t count = __builtin_popcountll(bits);
+					distanceSum[t] += count * level;
+					reached[t] += count;
+				}
+				if (!nextList.empty()) maxDistance[t] = std::max(maxDistance[t], level);
+				frontierList.swap(nextList);
+			}
+		}
+	});
+
+	uint64_t totalDistance = std::accumulate(distanceSum.begin(), distanceSum.end(), (uint64_t) 0);
+	uint64_t totalReached = std::accumulate(reached.begin(), reached.end(), (uint64_t) 0);
+	averagePathLength = totalReached ? (double) totalDistance / totalReached : 0.0;
+	diameter = *std::max_element(maxDistance.begin(), maxDistance.end());
+	unreachablePairs = (uint64_t) pathSources * (N - 1) - totalReached;
+}
+
+void GraphMetrics::write(std::ostream& out) const
+{
+	out << "# clustering=" << averageClustering << "\ttransitivity=" << transitivity
+	    << "\ttriangles=" << triangles << "\n";
+	out << "# averagePathLength=" << averagePathLength << "\tdiameter=" << diameter
+	    << "\tpathSources=" << pathSources << "\tunreachablePairs=" << unreachablePairs << "\n";
+	out << "# degreeHistogram=";
+	bool first = true;
+	for (size_t k = 0; k < degreeHistogram.size(); ++k) {
+		if (!degreeHistogram[k]) continue;
+		if (!first) out << ",";
+		out << k << ":" << degreeHistogram[k];
+		first = false;
+	}
+	out << "\n";
+}
@@ -0,0 +1,171 @@
+#include <iostream>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "output.hpp"
+
+namespace {
+
+const size_t DIRECT_ALIGNMENT = 4096;
+
+}
+
+AsyncFileBuffer::AsyncFileBuffer(std::string const& path, bool useDirect)
+	: path(path), fd(-1), holdPartialChunks(false), direct(false), head(0), tail(0), stopping(false), error(0),
+	  position(0), stallCount(0)
+{
+	for (size_t c = 0; c < CHUNKS; ++c) {
+		void* data = NULL;
+		// aligned for O_DIRECT
+		if (posix_memalign(&data, DIRECT_ALIGNMENT, CHUNK)) throw std::bad_alloc();
+		chunks[c].data = static_cast<char*>(data);
+		chunks[c].length = 0;
+		chunks[c].offset = 0;
+	}
+
+	const int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	if (useDirect) {
+		fd = open(path.c_str(), flags | O_DIRECT, 0644);
+		if (fd >= 0) holdPartialChunks = direct = true;
+		else std::cout << "O_DIRECT not supported for " << path << ", writing through the page cache\n";
+	}
+	if (fd < 0) fd = open(path.c_str(), flags, 0644);
+	setp(chunks[0].data, chunks[0].data + CHUNK);
+	if (fd >= 0) writer = std::thread(&AsyncFileBuffer::writerLoop, this);
+}
+
+AsyncFileBuffer::~AsyncFileBuffer()
+{
+	if (fd >= 0) {
+		try {
+			submit(true);
+		} catch (std::exception const&) {
+			// reported below
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping.store(true);
+		}
+		ready.notify_one();
+		writer.join();
+		if (int e = error.load()) std::cerr << "failed to write " << path << ": " << strerror(e) << "\n";
+		close(fd);
+	}
+	for (size_t c = 0; c < CHUNKS; ++c) free(chunks[c].data);
+}
+
+void AsyncFileBuffer::submit(bool partial)
+{
+	// hand the chunk being filled over to the writer, then wait for a free chunk if all are taken
+	size_t length = pptr() - pbase();
+	if (!length || (!partial && length < CHUNK)) return;
+	size_t h = head.load(std::memory_order_relaxed);
+	Chunk& chunk = chunks[h % CHUNKS];
+	chunk.length = length;
+	chunk.offset = position;
+	position += length;
+	head.store(h + 1, std::memory_order_release);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+	}
+	ready.notify_one();
+
+	if (h + 1 - tail.load(std::memory_order_acquire) == CHUNKS) {
+		++stallCount;
+		std::unique_lock<std::mutex> lock(mutex);
+		freed.wait(lock, [this, h]() { return h + 1 - tail.load(std::memory_order_acquire) < CHUNKS; });
+	}
+	Chunk& next = chunks[(h + 1) % CHUNKS];
+	setp(next.data, next.data + CHUNK);
+	checkErrors();
+}
+
+void AsyncFileBuffer::drain()
+{
+	submit(true);
+	std::unique_lock<std::mutex> lock(mutex);
+	freed.wait(lock, [this]() { return tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed); });
+	lock.unlock();
+	checkErrors();
+}
+
+void AsyncFileBuffer::checkErrors()
+{
+	if (int e = error.load()) throw std::runtime_error("failed to write " + path + ": " + strerror(e));
+}
+
+AsyncFileBuffer::int_type AsyncFileBuffer::overflow(int_type c)
+{
+	if (fd < 0) return traits_type::eof();
+	submit(false);
+	if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+int AsyncFileBuffer::sync()
+{
+	if (fd < 0) return -1;
+	// with O_DIRECT partial chunks wait for the chunk to fill up, see above
+	if (!holdPartialChunks) submit(true);
+	return 0;
+}
+
+AsyncFileBuffer::pos_type AsyncFileBuffer::seekoff(off_type offset, std::ios_base::seekdir dir, std::ios_base::openmode mode)
+{
+	pos_type current = (off_type) (position + (pptr() - pbase()));
+	if (dir == std::ios_base::cur && offset == 0) return current; // tellp
+	if (dir == std::ios_base::beg) return seekpos(offset, mode);
+	if (dir == std::ios_base::cur) return seekpos(current + offset, mode);
+	return pos_type(off_type(-1));
+}
+
+AsyncFileBuffer::pos_type AsyncFileBuffer::seekpos(pos_type target, std::ios_base::openmode mode)
+{
+	if (fd < 0 || !(mode & std::ios_base::out) || off_type(target) < 0) return pos_type(off_type(-1));
+	drain();
+	position = (off_type) target;
+	return target;
+}
+
+void AsyncFileBuffer::writerLoop()
+{
+	for (;;) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [this, t]() { return head.load(std::memory_order_acquire) != t || stopping.load(); });
+		}
+		if (head.load(std::memory_order_acquire) == t) return; // stopping with nothing left
+		writeChunk(chunks[t % CHUNKS]);
+		tail.store(t + 1, std::memory_order_release);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+		}
+		freed.notify_one();
+	}
+}
+
+void AsyncFileBuffer::writeChunk(Chunk& chunk)
+{
+	if (error.load()) return;
+	if (direct && (chunk.length % DIRECT_ALIGNMENT || chunk.offset % DIRECT_ALIGNMENT)) {
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+		direct = false;
+	}
+	size_t written = 0;
+	while (written < chunk.length) {
+		ssize_t n = pwrite(fd, chunk.data + written, chunk.length - written, chunk.offset + written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) {
+			error.store(n < 0 ? errno : EIO);
+			return;
+		}
+		written += n;
+	}
+}
@@ -0,0 +1,149 @@
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "pyramid.hpp"
+
+PyramidRecords::PyramidRecords(std::string const& directory, size_t baseEvents, std::string const& header, bool direct)
+	: directory(directory), header(header), baseEvents(baseEvents), direct(direct), closed(false)
+{
+	if (baseEvents < 1) throw std::runtime_error("pyramid bins need at least one event");
+	if (mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST)
+		throw std::runtime_error("failed to create pyramid directory " + directory);
+	const char* const names[VARIABLES] = {"r", "N0", "N1", "N2"};
+	columns.push_back(RecordColumn{"time", RecordColumn::FLOAT64});
+	columns.push_back(RecordColumn{"events", RecordColumn::FLOAT64});
+	for (int v = 0; v < VARIABLES; ++v) {
+		RecordColumn::Type type = v ? RecordColumn::INT32 : RecordColumn::FLOAT64;
+		columns.push_back(RecordColumn{std::string(names[v]) + "Min", type});
+		columns.push_back(RecordColumn{std::string(names[v]) + "Max", type});
+		columns.push_back(RecordColumn{std::string(names[v]) + "Mean", RecordColumn::FLOAT64});
+	}
+	levels.reserve(MAX_LEVELS);
+	addLevel();
+}
+
+PyramidRecords::~PyramidRecords()
+{
+	close();
+}
+
+void PyramidRecords::addLevel()
+{
+	int level = (int) levels.size();
+	std::ostringstream name, fields;
+	name << directory << "/level" << level << ".bin";
+	fields << "# level=" << level << "\tbinEvents=" << (baseEvents << level) << "\n" << header;
+
+	levels.push_back(Level());
+	Level& added = levels.back();
+	if (level == 0) {
+		added.buffer.reset(new AsyncFileBuffer(name.str(), direct));
+		if (!added.buffer->is_open()) throw std::runtime_error("failed to open " + name.str());
+		added.file.reset(new std::ostream(added.buffer.get()));
+	} else {
+		std::ofstream* file = new std::ofstream(name.str().c_str(), std::ios::out | std::ios::binary);
+		added.file.reset(file);
+		if (!file->is_open()) throw std::runtime_error("failed to open " + name.str());
+	}
+	added.file->exceptions(std::ios::badbit);
+	added.sink.reset(new RecordSink(*added.file, RecordSink::BINARY, columns, fields.str(), LEVEL_BLOCK_ROWS));
+	clear(added.current);
+	added.children = 0;
+}
+
+void PyramidRecords::clear(Bin& bin)
+{
+	bin.time = bin.events = bin.duration = 0;
+	for (int v = 0; v < VARIABLES; ++v) {
+		bin.minimum[v] = 1e300;
+		bin.maximum[v] = -1e300;
+		bin.sum[v] = 0;
+	}
+}
+
+void PyramidRecords::merge(Bin& bin, Bin const& child)
+{
+	bin.time = child.time;
+	bin.events += child.events;
+	bin.duration += child.duration;
+	for (int v = 0; v < VARIABLES; ++v) {
+		bin.minimum[v] = std::min(bin.minimum[v], child.minimum[v]);
+		bin.maximum[v] = std::max(bin.maximum[v], child.maximum[v]);
+		bin.sum[v] += child.sum[v];
+	}
+}
+
+void PyramidRecords::record(double time, double dt, int, const double* values)
+{
+	Level& base = levels[0];
+	Bin& bin = base.current;
+	bin.time = time;
+	bin.events += 1;
+	bin.duration += dt;
+	for (int v = 0; v < VARIABLES; ++v) {
+		bin.minimum[v] = std::min(bin.minimum[v], values[v]);
+		bin.maximum[v] = std::max(bin.maximum[v], values[v]);
+		bin.sum[v] += values[v]*dt;
+	}
+	if (++base.children == (int) baseEvents) emit(0);
+}
+
+void PyramidRecords::write(Level& level)
+{
+	Bin const& bin = level.current;
+	double row[2 + 3*VARIABLES];
+	row[0] = bin.time;
+	row[1] = bin.events;
+	for (int v = 0; v < VARIABLES; ++v) {
+		row[2 + 3*v] = bin.minimum[v];
+		row[3 + 3*v] = bin.maximum[v];
+		row[4 + 3*v] = bin.duration > 0 ? bin.sum[v] / bin.duration : 0;
+	}
+	level.sink->write(row);
+}
+
+void PyramidRecords::emit(int level)
+{
+	// completed bins carry up the levels like a binary counter
+	for (;;) {
+		write(levels[level]);
+
+		if (level + 1 == (int) levels.size()) {
+			if (level + 1 == MAX_LEVELS) break;
+			addLevel();
+		}
+		Level& parent = levels[level + 1];
+		merge(parent.current, levels[level].current);
+		clear(levels[level].current);
+		levels[level].children = 0;
+		if (++parent.children < 2) return;
+		++level;
+	}
+	clear(levels[level].current);
+	levels[level].children = 0;
+}
+
+void PyramidRecords::flush()
+{
+	for (size_t l = 0; l < levels.size(); ++l) levels[l].sink->flush();
+}
+
+void PyramidRecords::close()
+{
+	if (closed) return;
+	closed = true;
+	// partial bins, each merged into the level above before that level is written, so that every
+	// level covers all events. No level is added for them.
+	for (size_t l = 0; l < levels.size(); ++l) {
+		if (levels[l].children == 0) continue;
+		write(levels[l]);
+		if (l + 1 < levels.size()) {
+			merge(levels[l + 1].current, levels[l].current);
+			if (levels[l + 1].children == 0) levels[l + 1].children = 1;
+		}
+	}
+	for (size_t l = 0; l < levels.size(); ++l) levels[l].sink->close();
+}
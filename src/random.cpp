@@ -0,0 +1,187 @@
+#include <math.h>
+#ifdef __AVX512F__
+#include <immintrin.h>
+#endif
+
+#include "random.hpp"
+
+namespace {
+
+const uint64_t PCG_MULTIPLIER = 6364136223846793005ULL;
+const uint32_t PHILOX_M0 = 0xD2511F53, PHILOX_M1 = 0xCD9E8D57;
+const uint32_t PHILOX_W0 = 0x9E3779B9, PHILOX_W1 = 0xBB67AE85;
+const int PHILOX_ROUNDS = 10;
+
+#ifdef __AVX512F__
+// high and low 32-bit halves of the products of the 16 words of x by m. The zero-masked
+// forms with a full mask compile to the same instructions as the unmasked ones, whose GCC
+// 12 headers pass an undefined vector through and trip -Wuninitialized
+inline void mulHiLo(__m512i x, __m512i m, __m512i& hi, __m512i& lo)
+{
+	const __mmask8 ALL = 0xFF;
+	__m512i even = _mm512_maskz_mul_epu32(ALL, x, m);
+	__m512i odd = _mm512_maskz_mul_epu32(ALL, _mm512_maskz_srli_epi64(ALL, x, 32), m);
+	hi = _mm512_mask_blend_epi32(0xAAAA, _mm512_maskz_srli_epi64(ALL, even, 32), odd);
+	lo = _mm512_mask_blend_epi32(0xAAAA, even, _mm512_maskz_slli_epi64(ALL, odd, 32));
+}
+#endif
+
+inline uint32_t xshrr(uint64_t s)
+{
+	uint32_t xorshifted = (uint32_t) (((s >> 18) ^ s) >> 27);
+	uint32_t rot = (uint32_t) (s >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+}
+
+}
+
+const ExponentialZiggurat EXPONENTIAL_ZIGGURAT;
+
+ExponentialZiggurat::ExponentialZiggurat()
+{
+	// layer boundaries from the outside in, all layers having the same area 've'
+	const double m = 9007199254740992.0; // 2^53
+	const double ve = 3.949659822581572e-3;
+	double de = ZIGGURAT_EXPONENTIAL_TAIL, te = de;
+	double q = ve / exp(-de);
+
+	k[0] = (uint64_t) ((de / q) * m);
+	k[1] = 0;
+	w[0] = q / m;
+	w[LAYERS - 1] = de / m;
+	f[0] = 1.0;
+	f[LAYERS - 1] = exp(-de);
+	for (int i = LAYERS - 2; i >= 1; --i) {
+		de = -log(ve / de + exp(-de));
+		k[i + 1] = (uint64_t) ((de / te) * m);
+		te = de;
+		f[i] = exp(-de);
+		w[i] = de / m;
+	}
+}
+
+RandomBuffer::RandomBuffer() : position(BLOCK), counterMode(false)
+{
+	for (int l = 0; l < LANES; ++l) state[l] = increment[l] = 0;
+}
+
+RandomBuffer::RandomBuffer(pcg64& rng)
+{
+	seed(rng);
+}
+
+void RandomBuffer::seed(pcg64& rng)
+{
+	for (int l = 0; l < LANES; ++l) {
+		state[l] = rng();
+		increment[l] = rng() | 1;
+	}
+	position = BLOCK;
+	counterMode = false;
+}
+
+void RandomBuffer::setCounterStream(uint64_t seed, uint32_t newStream, uint32_t newSubstream)
+{
+	counterMode = true;
+	counterSeed = seed;
+	stream = newStream;
+	substream = newSubstream;
+	counterBlock = 0;
+	position = BLOCK;
+}
+
+void RandomBuffer::refill()
+{
+	if (counterMode) {
+		refillCounter();
+		return;
+	}
+
+	// each 64-bit number is made of two consecutive outputs of one lane. Lanes are laid out
+	// contiguously, so the inner loop is a straight SIMD loop over the lane arrays.
+	for (size_t j = 0; j < BLOCK; j += LANES) {
+		for (int l = 0; l < LANES; ++l) {
+			uint64_t s = state[l];
+			uint64_t high = xshrr(s);
+			s = s * PCG_MULTIPLIER + increment[l];
+			uint64_t low = xshrr(s);
+			state[l] = s * PCG_MULTIPLIER + increment[l];
+			buffer[j + l] = (high << 32) | low;
+		}
+	}
+	position = 0;
+}
+
+void RandomBuffer::refillCounter()
+{
+	// Philox4x32-10 on the counters (block, substream, stream), where block is the 64-bit index
+	// of a pair of output numbers. The rounds are applied to all blocks of the buffer one round
+	// at a time, so each round is a plain SIMD loop over independent blocks (32x32->64 bit
+	// products of the word arrays) instead of a chain of dependent multiplies.
+	const size_t BLOCKS = BLOCK / 2;
+	uint32_t c0[BLOCKS], c1[BLOCKS], c2[BLOCKS], c3[BLOCKS];
+	for (size_t b = 0; b < BLOCKS; ++b) {
+		uint64_t block = counterBlock + b;
+		c0[b] = (uint32_t) block;
+		c1[b] = (uint32_t) (block >> 32);
+		c2[b] = substream;
+		c3[b] = stream;
+	}
+	uint32_t k0 = (uint32_t) counterSeed, k1 = (uint32_t) (counterSeed >> 32);
+#ifdef __AVX512F__
+	// compilers turn the portable loop below into 64x64 bit multiplies, so with AVX-512 the
+	// rounds are written out for 64 blocks at a time: 4 independent vectors of 16 blocks, so
+	// that the multiply latency of one vector is hidden by the others
+	const __m512i m0 = _mm512_set1_epi32((int) PHILOX_M0), m1 = _mm512_set1_epi32((int) PHILOX_M1);
+	const int VECTORS = 4;
+	for (size_t b = 0; b < BLOCKS; b += 16*VECTORS) {
+		__m512i x0[VECTORS], x1[VECTORS], x2[VECTORS], x3[VECTORS];
+		for (int v = 0; v < VECTORS; ++v) {
+			x0[v] = _mm512_loadu_si512(c0 + b + 16*v);
+			x1[v] = _mm512_loadu_si512(c1 + b + 16*v);
+			x2[v] = _mm512_loadu_si512(c2 + b + 16*v);
+			x3[v] = _mm512_loadu_si512(c3 + b + 16*v);
+		}
+		uint32_t r0 = k0, r1 = k1;
+		for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+			__m512i key0 = _mm512_set1_epi32((int) r0), key1 = _mm512_set1_epi32((int) r1);
+			for (int v = 0; v < VECTORS; ++v) {
+				__m512i hi0, lo0, hi1, lo1;
+				mulHiLo(x0[v], m0, hi0, lo0);
+				mulHiLo(x2[v], m1, hi1, lo1);
+				x0[v] = _mm512_xor_si512(_mm512_xor_si512(hi1, x1[v]), key0);
+				x2[v] = _mm512_xor_si512(_mm512_xor_si512(hi0, x3[v]), key1);
+				x1[v] = lo1;
+				x3[v] = lo0;
+			}
+			r0 += PHILOX_W0;
+			r1 += PHILOX_W1;
+		}
+		for (int v = 0; v < VECTORS; ++v) {
+			_mm512_storeu_si512(c0 + b + 16*v, x0[v]);
+			_mm512_storeu_si512(c1 + b + 16*v, x1[v]);
+			_mm512_storeu_si512(c2 + b + 16*v, x2[v]);
+			_mm512_storeu_si512(c3 + b + 16*v, x3[v]);
+		}
+	}
+#else
+	for (int round = 0; round < PHILOX_ROUNDS; ++round) {
+		for (size_t b = 0; b < BLOCKS; ++b) {
+			uint64_t p0 = (uint64_t) c0[b] * PHILOX_M0;
+			uint64_t p1 = (uint64_t) c2[b] * PHILOX_M1;
+			c0[b] = (uint32_t) (p1 >> 32) ^ c1[b] ^ k0;
+			c2[b] = (uint32_t) (p0 >> 32) ^ c3[b] ^ k1;
+			c1[b] = (uint32_t) p1;
+			c3[b] = (uint32_t) p0;
+		}
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+#endif
+	for (size_t b = 0; b < BLOCKS; ++b) {
+		buffer[2*b] = ((uint64_t) c0[b] << 32) | c1[b];
+		buffer[2*b + 1] = ((uint64_t) c2[b] << 32) | c3[b];
+	}
+	counterBlock += BLOCKS;
+	position = 0;
+}
@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+#include "records.hpp"
+
+namespace {
+
+const size_t HEADER_ALIGNMENT = 4096;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+const char* const BYTE_ORDER_MARK = ">";
+#else
+const char* const BYTE_ORDER_MARK = "<";
+#endif
+
+size_t columnBytes(RecordColumn::Type type)
+{
+	return type == RecordColumn::FLOAT64 ? sizeof(double) : sizeof(int32_t);
+}
+
+const char* columnDtype(RecordColumn::Type type)
+{
+	return type == RecordColumn::FLOAT64 ? "f8" : "i4";
+}
+
+}
+
+std::vector<std::streampos> writePaddedHeader(std::ostream& out, std::string const& magic,
+                                              std::vector<std::string> const& counters, std::string const& fields)
+{
+	// the header size is printed into the header itself, so try sizes until the text fits
+	for (size_t bytes = HEADER_ALIGNMENT; ; bytes += HEADER_ALIGNMENT) {
+		std::ostringstream text;
+		text << magic << "\n"
+		     << "headerBytes=" << bytes << "\n";
+		std::vector<size_t> offsets;
+		for (size_t c = 0; c < counters.size(); ++c) {
+			text << counters[c] << "=";
+			offsets.push_back(text.str().size());
+			text << "00000000000000000000\n";
+		}
+		text << fields;
+		std::string header = text.str();
+		if (header.size() > bytes) continue;
+		header.resize(bytes, '\0');
+		std::streampos start = out.tellp();
+		out.write(header.data(), header.size());
+		std::vector<std::streampos> positions;
+		for (size_t c = 0; c < offsets.size(); ++c) positions.push_back(start + (std::streamoff) offsets[c]);
+		return positions;
+	}
+}
+
+void patchHeaderCounter(std::ostream& out, std::streampos position, uint64_t value)
+{
+	char digits[32];
+	snprintf(digits, sizeof(digits), "%020llu", (unsigned long long) value);
+	std::streampos end = out.tellp();
+	out.seekp(position);
+	out.write(digits, 20);
+	out.seekp(end);
+}
+
+RecordSink::RecordSink(std::ostream& out, Format format, std::vector<RecordColumn> const& columns, std::string const& header,
+                       size_t blockRows)
+	: out(out), format(format), columns(columns), closed(false), used(0), blockRows(blockRows), blockUsed(0), rows(0)
+{
+	if (columns.empty()) throw std::runtime_error("RecordSink needs at least one column");
+	if (format == TEXT) {
+		text.resize(TEXT_CAPACITY);
+		out << header;
+	} else {
+		blocks.resize(columns.size());
+		for (size_t c = 0; c < columns.size(); ++c) blocks[c].assign(blockRows * columnBytes(columns[c].type), 0);
+		std::ostringstream fields;
+		fields << "blockRows=" << blockRows << "\n"
+		       << "columns=";
+		for (size_t c = 0; c < columns.size(); ++c)
+			fields << (c ? "\t" : "") << columns[c].name << ":" << BYTE_ORDER_MARK << columnDtype(columns[c].type);
+		fields << "\n" << header;
+		rowsField = writePaddedHeader(out, "EDBIN 1", std::vector<std::string>(1, "rows"), fields.str())[0];
+	}
+}
+
+RecordSink::~RecordSink()
+{
+	close();
+}
+
+RecordSink::Format RecordSink::formatFromName(std::string const& name)
+{
+	if (name == "text") return TEXT;
+	if (name == "binary") return BINARY;
+	throw std::runtime_error("unknown record format '" + name + "'");
+}
+
+std::string RecordSink::extension(Format format)
+{
+	return format == BINARY ? ".bin" : ".txt";
+}
+
+std::string RecordSink::columnNames(std::vector<RecordColumn> const& columns)
+{
+	std::string line = "#";
+	for (size_t c = 0; c < columns.size(); ++c) line += (c ? "\t" : " ") + columns[c].name;
+	return line + "\n";
+}
+
+void RecordSink::write(const double* values)
+{
+	if (format == BINARY) {
+		for (size_t c = 0; c < columns.size(); ++c) {
+			if (columns[c].type == RecordColumn::FLOAT64) {
+				memcpy(&blocks[c][blockUsed * sizeof(double)], &values[c], sizeof(double));
+			} else {
+				int32_t value = (int32_t) values[c];
+				memcpy(&blocks[c][blockUsed * sizeof(int32_t)], &value, sizeof(int32_t));
+			}
+		}
+		++rows;
+		if (++blockUsed == blockRows) writeBlock();
+		return;
+	}
+	if (used + columns.size() * MAX_TEXT_VALUE > TEXT_CAPACITY) flush();
+	// same digits as 'std::fixed << std::setprecision(12)'
+	for (size_t c = 0; c < columns.size(); ++c) {
+		char separator = c + 1 < columns.size() ? '\t' : '\n';
+		int n = columns[c].type == RecordColumn::FLOAT64
+			? snprintf(&text[used], MAX_TEXT_VALUE, "%.12f%c", values[c], separator)
+			: snprintf(&text[used], MAX_TEXT_VALUE, "%d%c", (int) values[c], separator);
+		if (n < 0 || (size_t) n >= MAX_TEXT_VALUE) throw std::runtime_error("record value too long for RecordSink");
+		used += n;
+	}
+}
+
+void RecordSink::writeTrailer(size_t value)
+{
+	if (format == BINARY) {
+		std::vector<double> row(columns.size(), 0.0);
+		row[0] = (double) value;
+		write(row.data());
+		return;
+	}
+	if (used + columns.size() * MAX_TEXT_VALUE > TEXT_CAPACITY) flush();
+	used += snprintf(&text[used], MAX_TEXT_VALUE, "%zu", value);
+	for (size_t c = 1; c < columns.size(); ++c) used += snprintf(&text[used], MAX_TEXT_VALUE, "\t0");
+	text[used++] = '\n';
+}
+
+void RecordSink::writeBlock()
+{
+	for (size_t c = 0; c < columns.size(); ++c) {
+		// the unused tail of a last block holds zeros
+		size_t bytes = columnBytes(columns[c].type);
+		std::fill(blocks[c].begin() + blockUsed * bytes, blocks[c].end(), 0);
+		out.write(blocks[c].data(), blocks[c].size());
+	}
+	blockUsed = 0;
+}
+
+void RecordSink::flush()
+{
+	if (format == TEXT && used) {
+		out.write(&text[0], used);
+		used = 0;
+	}
+	out.flush();
+}
+
+void RecordSink::close()
+{
+	if (closed) return;
+	closed = true;
+	if (format == TEXT) {
+		flush();
+		return;
+	}
+	if (blockUsed) writeBlock();
+	patchHeaderCounter(out, rowsField, rows);
+	out.flush();
+}
+
+EventRecords::EventRecords(RecordSink& sink) : sink(sink), row(sink.numberOfColumns())
+{
+}
+
+void EventRecords::record(double time, double, int, const double* values)
+{
+	row[0] = time;
+	std::copy(values, values + row.size() - 1, row.begin() + 1);
+	sink.write(row.data());
+}
+
+TimeGridRecords::TimeGridRecords(RecordSink& sink, Spacing spacing, double first, double perDecade, size_t variables, bool means)
+	: sink(sink), spacing(spacing), first(first), ratio(pow(10.0, 1.0 / perDecade)),
+	  variables(variables), means(means), index(0), next(first), binStart(0),
+	  sums(variables, 0.0), row(1 + (means ? 2 : 1) * variables)
+{
+	if (!(first > 0)) throw std::runtime_error("the first time of a time grid must be positive");
+	if (spacing == LOGARITHMIC && !(perDecade > 0)) throw std::runtime_error("a logarithmic time grid needs a positive number of points per decade");
+	if (sink.numberOfColumns() != row.size()) throw std::runtime_error("time grid and record sink disagree on the number of columns");
+}
+
+TimeGridRecords::Spacing TimeGridRecords::spacingFromName(std::string const& name)
+{
+	if (name == "linear") return LINEAR;
+	if (name == "log") return LOGARITHMIC;
+	throw std::runtime_error("unknown time grid spacing '" + name + "'");
+}
+
+void TimeGridRecords::advance()
+{
+	// grid times are computed from their index, so rounding errors don't accumulate
+	++index;
+	next = spacing == LINEAR ? first * (index + 1) : first * pow(ratio, (double) index);
+}
+
+void TimeGridRecords::record(double time, double dt, int, const double* values)
+{
+	// the state holds on [time - dt, time): it is the state at every grid time in that interval
+	double start = time - dt;
+	while (next < time) {
+		if (means) {
+			double weight = next - std::max(start, binStart);
+			double length = next - binStart;
+			for (size_t v = 0; v < variables; ++v) {
+				row[1 + variables + v] = (sums[v] + values[v] * weight) / length;
+				sums[v] = 0;
+			}
+		}
+		row[0] = next;
+		std::copy(values, values + variables, row.begin() + 1);
+		sink.write(row.data());
+		binStart = next;
+		advance();
+	}
+	if (means) {
+		double weight = time - std::max(start, binStart);
+		for (size_t v = 0; v < variables; ++v) sums[v] += values[v] * weight;
+	}
+}
@@ -0,0 +1,97 @@
+#include <string.h>
+#include <stdexcept>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "telemetry.hpp"
+
+static_assert(sizeof(std::atomic<uint64_t>) == 8, "the telemetry sequence must be a plain 64-bit word");
+static_assert(sizeof(TelemetryFrame) == 96 + 4*TelemetryFrame::MAX_STATES + 8*TelemetryFrame::HISTORY,
+              "the telemetry frame layout must not have padding");
+
+TelemetryChannel::TelemetryChannel(std::string const& name, int N, int Q, size_t interval)
+	: name(name), Q(std::min(Q, (int) TelemetryFrame::MAX_STATES)), interval(std::max<size_t>(interval, 1)),
+	  frame(NULL), pending(0), time(0), events(0), lastEvents(0), lastPublished(std::chrono::steady_clock::now())
+{
+	int fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+	if (fd < 0) throw std::runtime_error("failed to create telemetry segment /" + name);
+	if (ftruncate(fd, sizeof(TelemetryFrame)) != 0) {
+		::close(fd);
+		shm_unlink(("/" + name).c_str());
+		throw std::runtime_error("failed to size telemetry segment /" + name);
+	}
+	void* mapped = mmap(NULL, sizeof(TelemetryFrame), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (mapped == MAP_FAILED) {
+		shm_unlink(("/" + name).c_str());
+		throw std::runtime_error("failed to map telemetry segment /" + name);
+	}
+	// the segment is zero filled by ftruncate, so the sequence starts even
+	frame = static_cast<TelemetryFrame*>(mapped);
+	frame->pid = getpid();
+	frame->N = N;
+	frame->Q = this->Q;
+	frame->phase = RELAXATION;
+	memcpy(frame->magic, "EDTEL 1", 8);
+}
+
+TelemetryChannel::~TelemetryChannel()
+{
+	setPhase(FINISHED, frame->couplingIndex, frame->couplings, frame->coupling, frame->trial, frame->trials);
+	munmap(frame, sizeof(TelemetryFrame));
+	shm_unlink(("/" + name).c_str());
+}
+
+void TelemetryChannel::setPhase(Phase phase, int couplingIndex, int couplings, double coupling, int trial, int trials)
+{
+	uint64_t sequence = frame->sequence.load(std::memory_order_relaxed);
+	frame->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	frame->phase = phase;
+	frame->couplingIndex = couplingIndex;
+	frame->couplings = couplings;
+	frame->coupling = coupling;
+	frame->trial = trial;
+	frame->trials = trials;
+	frame->events = 0;
+	frame->time = 0;
+	frame->sequence.store(sequence + 2, std::memory_order_release);
+	pending = 0;
+	time = 0;
+	events = lastEvents = 0;
+	lastPublished = std::chrono::steady_clock::now();
+}
+
+void TelemetryChannel::record(double, double dt, int, const double* values)
+{
+	time += dt;
+	if (++pending < interval) return;
+	// the records only hold N0, N1 and N2
+	int populations[] = {(int) values[1], (int) values[2], (int) values[3]};
+	publish(values[0], populations, 3);
+}
+
+void TelemetryChannel::publish(double r, const int* populations, int states)
+{
+	events += pending;
+	pending = 0;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(now - lastPublished).count();
+
+	uint64_t sequence = frame->sequence.load(std::memory_order_relaxed);
+	frame->sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	frame->events = events;
+	frame->time = time;
+	if (seconds > 0) frame->eventsPerSecond = (events - lastEvents) / seconds;
+	frame->r = r;
+	memcpy(frame->populations, populations, std::min(states, Q) * sizeof(int));
+	frame->history[frame->historyCount % TelemetryFrame::HISTORY] = r;
+	++frame->historyCount;
+	frame->sequence.store(sequence + 2, std::memory_order_release);
+
+	lastEvents = events;
+	lastPublished = now;
+}
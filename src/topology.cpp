@@ -1,118 +1,740 @@
 #include <iostream>
 #include <math.h>
 #include <random>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <stdint.h>
+#include <limits>
+#include <string.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "pcg_random.hpp"
+#include "random.hpp"
 #include "topology.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// header of the binary CSR format. It is followed by (N+1) uint64 kernel offsets and
+// by the int32 kernel entries. All values are stored in native (little endian) byte order.
+const char CSR_MAGIC[8] = {'E', 'D', 'C', 'S', 'R', '0', '1', '\0'};
+struct CSRHeader {
+	char magic[8];
+	uint64_t N;
+	uint64_t entries;
+};
+
+// read only memory map of a whole file, unmapped on destruction
+class MappedFile {
+public:
+	explicit MappedFile(std::string const& path) : data(NULL), size(0)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("failed to open graph file '" + path + "'");
+		struct stat st;
+		if (fstat(fd, &st) != 0) {
+			close(fd);
+			throw std::runtime_error("failed to stat graph file '" + path + "'");
+		}
+		size = (size_t) st.st_size;
+		if (size > 0) {
+			void* ptr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (ptr == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("failed to map graph file '" + path + "'");
+			}
+			madvise(ptr, size, MADV_SEQUENTIAL);
+			data = static_cast<const char*>(ptr);
+		}
+		close(fd);
+	}
+	~MappedFile() { if (data) munmap(const_cast<char*>(data), size); }
+
+	const char* data;
+	size_t size;
+private:
+	MappedFile(MappedFile const&);
+	MappedFile& operator=(MappedFile const&);
+};
+
+}
 
 Topology::Topology(
 		int const N,
 		int const k,
 	   	double const p,
 		bool const NON_DETERMINISTIC_TOPOLOGY
-		) : N(N), k(k), p(p), NON_DETERMINISTIC_TOPOLOGY(NON_DETERMINISTIC_TOPOLOGY)
+		) : Topology(RING, N, k, p, NON_DETERMINISTIC_TOPOLOGY)
 {
-	createRing();
+}
 
-	// get minimum and maximum number of kernel sizes
-	minNeighbors = maxNeighbors = kernelSizes[0];
-	for (int i = 1; i < N; ++i) {
-		int size = kernelSizes[i];
-		if(size > maxNeighbors) maxNeighbors = size;
-		else if(size < minNeighbors) minNeighbors = size;
+Topology::Topology(
+		GraphType const graphType,
+		int const N,
+		int const k,
+	   	double const p,
+		bool const NON_DETERMINISTIC_TOPOLOGY
+		) : graphType(graphType), N(N), k(k), p(p), NON_DETERMINISTIC_TOPOLOGY(NON_DETERMINISTIC_TOPOLOGY)
+{
+	if (N < 2 || k < 1) throw std::runtime_error("topology needs N >= 2 and k >= 1");
+
+	switch(graphType) {
+		case RING:
+			createRing();
+			break;
+		case ERDOS_RENYI:
+			createErdosRenyi();
+			break;
+		case LATTICE_2D:
+			createHypercubic(2);
+			break;
+		case LATTICE_3D:
+			createHypercubic(3);
+			break;
+		case BARABASI_ALBERT:
+			createBarabasiAlbert();
+			break;
+		case RANDOM_REGULAR:
+			createRandomRegular();
+			break;
+		default:
+			throw std::runtime_error("invalid graph type in 'Topology' constructor");
 	}
+
+	updateNeighborRange();
+}
+
+Topology::Topology(std::string const& path) : Topology(
+		[&path]() {
+			std::ifstream file(path.c_str(), std::ios::binary);
+			char magic[sizeof(CSR_MAGIC)] = {0};
+			file.read(magic, sizeof(magic));
+			if (file && memcmp(magic, CSR_MAGIC, sizeof(magic)) == 0) return readBinary(path);
+			return readEdgeList(path);
+		}())
+{
+}
+
+Topology::Topology(Kernels&& graph) :
+	kernelList(std::move(graph.kernelList)),
+	kernelId(std::move(graph.kernelId)),
+	graphType(IMPORTED), N(graph.N), k(0), p(0.0), NON_DETERMINISTIC_TOPOLOGY(false)
+{
+	updateNeighborRange();
+	std::cout << "\nImported graph with N=" << N << " and " << kernelList.size()/2 << " edges\n";
+}
+
+Topology::Kernels Topology::readBinary(std::string const& path)
+{
+	// the kernel entries are copied straight out of the mapping with a single memcpy, no
+	// parsing is involved. Offsets are narrowed to 'edge_t' kernel indexes on the way.
+	MappedFile file(path);
+	CSRHeader header;
+	if (file.size < sizeof(header)) throw std::runtime_error("truncated binary graph file");
+	memcpy(&header, file.data, sizeof(header));
+	if (header.N < 1 || header.N > (uint64_t) INT32_MAX) throw std::runtime_error("invalid number of vertices in binary graph file");
+	checkEntries(header.entries);
+	size_t offsetsBytes = (header.N + 1) * sizeof(uint64_t);
+	size_t entriesBytes = header.entries * sizeof(int32_t);
+	if (file.size != sizeof(header) + offsetsBytes + entriesBytes)
+		throw std::runtime_error("binary graph file size does not match its header");
+
+	Kernels graph;
+	graph.N = (int) header.N;
+	graph.kernelId.resize(graph.N + 1);
+	const char* offsets = file.data + sizeof(header);
+	uint64_t begin = 0, end;
+	for (int i = 0; i <= graph.N; ++i) {
+		memcpy(&end, offsets + i * sizeof(uint64_t), sizeof(end));
+		if (end < begin || end > header.entries || (i == 0 && end != 0))
+			throw std::runtime_error("invalid kernel offsets in binary graph file");
+		graph.kernelId[i] = (edge_t) end;
+		begin = end;
+	}
+	if (begin != header.entries) throw std::runtime_error("invalid kernel offsets in binary graph file");
+
+	graph.kernelList.resize(header.entries);
+	if (entriesBytes) memcpy(&graph.kernelList[0], offsets + offsetsBytes, entriesBytes);
+	validateKernels(graph, false);
+	return graph;
+}
+
+Topology::Kernels Topology::readEdgeList(std::string const& path)
+{
+	// text edge list with one undirected edge "u v" per line and 0-based vertex indexes.
+	// Lines starting with '#' or '%' are comments. Edges may be listed in one or both
+	// directions. The mapped file is split at line boundaries and parsed by all threads.
+	MappedFile file(path);
+	const char* data = file.data;
+	size_t size = file.size;
+	if (size == 0) throw std::runtime_error("edge list '" + path + "' is empty");
+
+	unsigned int threads = numberOfThreads();
+	std::vector<size_t> chunkStart(threads + 1, size);
+	chunkStart[0] = 0;
+	for (unsigned int t = 1; t < threads; ++t) {
+		size_t pos = std::max(size * t / threads, std::max<size_t>(chunkStart[t-1], 1));
+		while (pos < size && data[pos - 1] != '\n') ++pos;
+		chunkStart[t] = pos;
+	}
+
+	std::vector<std::vector<std::pair<int,int> > > edges(threads);
+	std::vector<long> maxVertex(threads, -1);
+	parallelFor(threads, [&](unsigned int, size_t first, size_t last) {
+		for (size_t t = first; t < last; ++t) {
+			const char* pos = data + chunkStart[t];
+			const char* end = data + chunkStart[t + 1];
+			while (pos < end) {
+				while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r')) ++pos;
+				if (pos == end) break;
+				if (*pos == '\n') { ++pos; continue; }
+				if (*pos == '#' || *pos == '%') {
+					while (pos < end && *pos != '\n') ++pos;
+					continue;
+				}
+				long vertices[2];
+				for (int j = 0; j < 2; ++j) {
+					while (pos < end && (*pos == ' ' || *pos == '\t')) ++pos;
+					if (pos == end || *pos < '0' || *pos > '9')
+						throw std::runtime_error("malformed line in edge list '" + path + "'");
+					long v = 0;
+					while (pos < end && *pos >= '0' && *pos <= '9') {
+						v = 10*v + (*pos - '0');
+						if (v > INT32_MAX - 1) throw std::runtime_error("vertex index too large in edge list");
+						++pos;
+					}
+					vertices[j] = v;
+				}
+				// ignore anything else on the line, such as edge weights
+				while (pos < end && *pos != '\n') ++pos;
+				if (vertices[0] == vertices[1]) throw std::runtime_error("self-loop found in edge list");
+				edges[t].push_back(std::make_pair((int) vertices[0], (int) vertices[1]));
+				maxVertex[t] = std::max(maxVertex[t], std::max(vertices[0], vertices[1]));
+			}
+		}
+	});
+
+	for (unsigned int t = 1; t < threads; ++t) {
+		edges[0].insert(edges[0].end(), edges[t].begin(), edges[t].end());
+		std::vector<std::pair<int,int> >().swap(edges[t]);
+		maxVertex[0] = std::max(maxVertex[0], maxVertex[t]);
+	}
+	if (maxVertex[0] < 1) throw std::runtime_error("edge list '" + path + "' has no edges");
+
+	Kernels graph;
+	graph.N = (int) maxVertex[0] + 1;
+	buildKernels(graph.N, edges[0], graph.kernelList, graph.kernelId);
+	validateKernels(graph, true);
+	return graph;
+}
+
+void Topology::validateKernels(Kernels& graph, bool removeDuplicates)
+{
+	// sort every kernel (their order has no effect on the dynamics) and check that the graph is
+	// simple and undirected: no self-loops, no repeated neighbors and j in kernel(i) <=> i in kernel(j).
+	// Edge lists listing both directions of an edge produce duplicates, which may be removed.
+	int N = graph.N;
+	large_vector<vertex_t>& list = graph.kernelList;
+	large_vector<edge_t>& id = graph.kernelId;
+
+	std::vector<int> duplicates(N, 0);
+	parallelFor(N, [&](unsigned int, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			large_vector<vertex_t>::iterator begin = list.begin() + id[i];
+			large_vector<vertex_t>::iterator end = list.begin() + id[i + 1];
+			std::sort(begin, end);
+			for (large_vector<vertex_t>::iterator it = begin; it != end; ++it) {
+				if (*it < 0 || *it >= N) throw std::runtime_error("kernel entry out of range in imported graph");
+				if (*it == (int) i) throw std::runtime_error("self-loop found in imported graph");
+			}
+			large_vector<vertex_t>::iterator unique = std::unique(begin, end);
+			duplicates[i] = (int) (end - unique);
+		}
+	});
+
+	if (std::accumulate(duplicates.begin(), duplicates.end(), 0L) > 0) {
+		if (!removeDuplicates) throw std::runtime_error("repeated edge found in imported graph");
+		// compact the kernels, whose unique entries are at the start of each kernel
+		edge_t sum = 0, begin = id[0];
+		for (int i = 0; i < N; ++i) {
+			edge_t end = id[i + 1];
+			edge_t newSize = end - begin - duplicates[i];
+			std::copy(list.begin() + begin, list.begin() + begin + newSize, list.begin() + sum);
+			id[i] = sum;
+			sum += newSize;
+			begin = end;
+		}
+		id[N] = sum;
+		list.resize(sum);
+		large_vector<vertex_t>(list).swap(list);
+	}
+
+	parallelFor(N, [&](unsigned int, size_t first, size_t last) {
+		for (size_t i = first; i < last; ++i) {
+			for (edge_t j = id[i]; j < id[i + 1]; ++j) {
+				int n = list[j];
+				if (!std::binary_search(list.begin() + id[n], list.begin() + id[n + 1], (int) i))
+					throw std::runtime_error("imported graph is not symmetric");
+			}
+		}
+	});
 }
 
 void Topology::createRing()
 {
-	// populate the three relevant vectors:
-	// kernelSizes - store the number of edges emanating from each vertex (N elements)
-	// kernelList - stores a list of connected vertices (kernel) for each vertex (N*k elements)
-	// kernelId - stores the begining of kernel for each vertex (N elements)
+	// populate the two relevant vectors:
+	// kernelList - stores a list of connected vertices (kernel) for each vertex (N*2k elements)
+	// kernelId - stores the begining of kernel for each vertex and the end of the last one (N+1 elements)
 	//
-	// Start by making a regular ring with trivial kernel sizes of 2k for every vertex
+	// Start by making a regular ring with trivial kernel sizes of 2k for every vertex.
+	// Both vectors are allocated once at their final size, so no growth reallocations
+	// double the peak memory of large rings.
+	checkEntries((uint64_t) N * 2*k);
+	kernelList.resize((size_t) N * 2*k);
+	size_t entry = 0;
 	for (int i = 0; i < N; ++i) {
 		for (int j = -k; j <= k; ++j) {
 			if (j == 0) continue; // a site cannot have itself in its own kernel
 			int idx = i + j;
 			if (idx < 0) idx += N;
 			else if (idx >= N) idx -= N;
-			kernelList.push_back(idx);
+			kernelList[entry++] = idx;
 		}
-		kernelSizes.push_back(2*k);
 	}
 
 	// generate kernel indexes
-	int sum = 0;
-	for(int i = 0; i < N; ++i) {
-		kernelId.push_back(sum);
+	kernelId.resize(N + 1);
+	for(int i = 0; i <= N; ++i) kernelId[i] = (edge_t) 2*k*i;
+
+	rewireSeed = 42u;
+	if(NON_DETERMINISTIC_TOPOLOGY) rewireSeed = pcg_extras::generate_one<uint64_t>(pcg_extras::seed_seq_from<std::random_device>());
+
+	double rewireProbability = p;
+	p = 0.0;
+	if (rewireProbability == 0.0) {
+		// the rewiring state is only allocated when the ring is first rewired
+		std::cout << "\nCreated regular ring with N=" << N << " and k=" << k << "\n";
+	} else {
+		rewireTo(rewireProbability);
+		std::cout << "\nCreated rewired ring with N="<<N<<" k="<<k<<" and p="<<p<<"\n";
+	}
+}
+
+std::vector<int> Topology::rewireTo(double newP)
+{
+	// Rewire the ring to probability newP and return the sorted list of vertices whose kernels changed.
+	//
+	// Each clockwise edge e=(i, i+j) owns the pcg64 stream e of 'rewireSeed'. Its first uniform is
+	// the edge's rewire threshold and the following draws pick its new endpoint. The ring at
+	// probability p is obtained by rewiring, in increasing threshold order, every edge with a
+	// threshold below p. Since thresholds and targets are fixed per edge, rings at different p
+	// are coupled, and moving from p to a larger p' only applies edges with thresholds in [p, p').
+	// Lowering p rebuilds the regular ring and replays all edges below the new p.
+	if (graphType != RING) throw std::runtime_error("only rings can be rewired");
+	if (newP < 0.0 || newP > 1.0) throw std::runtime_error("rewire probability must be in [0, 1]");
+	if (forwardTarget.empty()) {
+		if (p != 0.0) throw std::runtime_error("rewiring state of the ring was released");
+		resetForwardTargets();
+	}
+
+	std::vector<int> affected;
+	std::vector<int> kernelSizes(N);
+	for (int i = 0; i < N; ++i) kernelSizes[i] = kernelSize(i);
+	double oldP = p;
+	// the kernels are rebuilt from the reset targets even if no edge lies below the new p
+	bool lowered = newP < oldP;
+	if (lowered) {
+		resetForwardTargets();
+		kernelSizes.assign(N, 2*k);
+		rewiredEdges.clear();
+		oldP = 0.0;
+		affected.resize(N);
+		for (int i = 0; i < N; ++i) affected[i] = i;
+	}
+	p = newP;
+
+	// find the edges with thresholds in [oldP, newP). Only the first draw of each stream is needed.
+	size_t numEdges = forwardTarget.size();
+	unsigned int threads = numberOfThreads();
+	std::vector<std::vector<std::pair<double, size_t> > > found(threads);
+	uint64_t seed = rewireSeed;
+	parallelFor(numEdges, [&](unsigned int t, size_t first, size_t last) {
+		for (size_t e = first; e < last; ++e) {
+			pcg64 edgeRng(seed, e);
+			double threshold = uniformFromBits(edgeRng());
+			if (threshold >= oldP && threshold < newP) found[t].push_back(std::make_pair(threshold, e));
+		}
+	});
+	std::vector<std::pair<double, size_t> > rewires;
+	for (unsigned int t = 0; t < threads; ++t) rewires.insert(rewires.end(), found[t].begin(), found[t].end());
+	std::sort(rewires.begin(), rewires.end());
+
+	for (size_t r = 0; r < rewires.size(); ++r) {
+		size_t e = rewires[r].second;
+		int currentVertex = (int) (e / k);
+		int cutVertex = forwardTarget[e];
+
+		// prevent rewiring from leaving isolated vertices and also chosing invalid edges
+		if (kernelSizes[cutVertex] <= 1 || kernelSizes[currentVertex] >= N - 1) continue;
+		pcg64 edgeRng(rewireSeed, e);
+		edgeRng(); // skip the threshold
+		int randomVertex = (int) boundedRandom(edgeRng, N);
+		while (randomVertex == currentVertex || isConnected(currentVertex, randomVertex)) randomVertex = (int) boundedRandom(edgeRng, N);
+
+		forwardTarget[e] = randomVertex;
+		rewiredEdges.insert(edgeKey(currentVertex, randomVertex));
+		kernelSizes[cutVertex]--;
+		kernelSizes[randomVertex]++;
+		affected.push_back(currentVertex);
+		affected.push_back(cutVertex);
+		affected.push_back(randomVertex);
+	}
+
+	if (lowered || !rewires.empty()) {
+		buildRingKernels(kernelSizes);
+		updateNeighborRange();
+	}
+	std::sort(affected.begin(), affected.end());
+	affected.erase(std::unique(affected.begin(), affected.end()), affected.end());
+	return affected;
+}
+
+void Topology::resetForwardTargets()
+{
+	// every clockwise edge (i, i+j) starts attached to its ring endpoint
+	forwardTarget.resize((size_t) N * k);
+	for (int i = 0; i < N; ++i) {
+		for (int j = 1; j <= k; ++j) forwardTarget[(size_t) i*k + j - 1] = (i + j) % N;
+	}
+}
+
+void Topology::releaseRewiringState()
+{
+	// free the per-edge rewiring state of a ring that will not be rewired again
+	large_vector<vertex_t>().swap(forwardTarget);
+	std::unordered_set<uint64_t>().swap(rewiredEdges);
+}
+
+void Topology::buildRingKernels(std::vector<int> const& kernelSizes)
+{
+	// rebuild kernelList and kernelId from the endpoints of the clockwise edges, given the
+	// kernel sizes which are kept up to date while rewiring.
+	edge_t sum = 0;
+	for (int i = 0; i < N; ++i) {
+		kernelId[i] = sum;
 		sum += kernelSizes[i];
 	}
+	kernelId[N] = sum;
+	kernelList.resize(sum);
+	large_vector<edge_t> fill(kernelId);
+	for (size_t e = 0; e < forwardTarget.size(); ++e) {
+		int a = (int) (e / k), b = forwardTarget[e];
+		kernelList[fill[a]++] = b;
+		kernelList[fill[b]++] = a;
+	}
+}
 
-	if (p == 0.0) {
-		std::cout << "\nCreated regular ring with N=" << N << " and k=" << k << "\n";
+bool Topology::isConnected(int a, int b) const
+{
+	// two vertices are connected either by a ring edge that was never rewired or by a rewired edge
+	int distance = b - a;
+	if (distance < 0) distance += N;
+	int origin = a;
+	if (distance > k) {
+		distance = N - distance;
+		origin = b;
+	}
+	if (distance >= 1 && distance <= k) {
+		int ringEndpoint = (origin + distance) % N;
+		if (forwardTarget[(size_t) origin*k + distance - 1] == ringEndpoint) return true;
+	}
+	return rewiredEdges.count(edgeKey(a, b)) > 0;
+}
+
+uint64_t Topology::edgeKey(int a, int b) const
+{
+	return a < b ? (uint64_t) a * N + b : (uint64_t) b * N + a;
+}
+
+void Topology::updateNeighborRange()
+{
+	// get minimum and maximum number of kernel sizes in a single pass
+	minNeighbors = maxNeighbors = kernelSize(0);
+	for (int i = 1; i < N; ++i) {
+		minNeighbors = std::min(minNeighbors, kernelSize(i));
+		maxNeighbors = std::max(maxNeighbors, kernelSize(i));
+	}
+}
+
+void Topology::createErdosRenyi()
+{
+	// G(N,q) with q chosen for a mean degree of 2k. Instead of flipping a coin for each of
+	// the N(N-1)/2 pairs, jump directly to the next present edge by drawing geometrically
+	// distributed gaps (Batagelj & Brandes, 2005). This costs O(N + edges).
+	if (2*k > N-1) throw std::runtime_error("Erdos-Renyi graph needs 2k <= N-1");
+	double q = 2.0*k / (N - 1);
+
+	pcg64 rng(42u, 54u);
+	seedGenerator(rng);
+
+	std::vector<std::pair<int,int> > edges;
+	edges.reserve((size_t) (q * N * (N - 1) / 2 * 1.05) + 16);
+	if (q >= 1.0) {
+		for (int v = 1; v < N; ++v)
+			for (int w = 0; w < v; ++w) edges.push_back(std::make_pair(v, w));
 	} else {
-		// make an rng
-		pcg64 rng(42u, 54u);
-		std::uniform_real_distribution<double> uniform(0.0, 1.0);
-		if(NON_DETERMINISTIC_TOPOLOGY) rng.seed(pcg_extras::seed_seq_from<std::random_device>());
-
-		// for each vertex, loop only through the k clockwise edges
-		for (int currentVertex = 0; currentVertex < N-1; ++currentVertex) {
-			for (int j = 1; j <= k; j++) {
-				if (uniform(rng) > p) continue; // rewire edge with probability p
-
-				int cutVertex = currentVertex + j;
-				if (cutVertex >= N) cutVertex -= N;
-
-				// prevent rewiring from leaving isolated vertices and also chosing invalid edges
-				if (kernelSizes[cutVertex] <= 1) continue;
-				int randomVertex = rng(N);
-				while (isInKernel(currentVertex, randomVertex) || randomVertex == currentVertex) randomVertex = rng(N);
-
-				// swap the endpoint of the edge
-				std::vector<int>::iterator first = kernelList.begin() + kernelId[currentVertex];
-				std::vector<int>::iterator last = first + kernelSizes[currentVertex];
-				std::vector<int>::iterator swapPoint = std::find(first, last, cutVertex);
-				if (swapPoint != last) *swapPoint = randomVertex;
-				else throw std::runtime_error("cut vertex not in current vertex kernel");
-
-				// remove the current vertex from the cut vertex kernel
-				first = kernelList.begin() + kernelId[cutVertex];
-				last = first + kernelSizes[cutVertex];
-				std::vector<int>::iterator removePoint = std::find(first, last, currentVertex);
-				if (removePoint != last) kernelList.erase(removePoint);
-				else throw std::runtime_error("Trying to remove inexistent vertex from kernel");
-				for (int i = cutVertex + 1; i < N; ++i) kernelId[i]--;
-				kernelSizes[cutVertex]--;
-
-				// insert the current vertex at the end of randomly selected vertex kernel
-				std::vector<int>::iterator insertPoint = kernelList.begin() + kernelId[randomVertex] + kernelSizes[randomVertex];
-				kernelList.insert(insertPoint, currentVertex);
-				// increment indexes after the insertion point
-				for (int i = randomVertex + 1; i < N; ++i) kernelId[i]++;
-				kernelSizes[randomVertex]++;
+		// walk the lower triangle (v,w) with w < v in row major order
+		double logq = log(1.0 - q);
+		long v = 1, w = -1;
+		while (v < N) {
+			w += 1 + (long) floor(log(1.0 - uniformFromBits(rng())) / logq);
+			while (w >= v && v < N) {
+				w -= v;
+				++v;
 			}
+			if (v < N) edges.push_back(std::make_pair((int) v, (int) w));
 		}
-		std::cout << "\nCreated rewired ring with N="<<N<<" k="<<k<<" and p="<<p<<"\n";
 	}
+	buildKernels(edges);
+
+	std::cout << "\nCreated Erdos-Renyi graph with N=" << N << " and q=" << q << "\n";
+}
+
+void Topology::createHypercubic(int dim)
+{
+	// periodic hypercubic lattice of side L=N^(1/dim). The kernel of every site is a stencil
+	// of k sites in both directions along each axis, so every kernel has 2*dim*k elements.
+	int L = (int) round(pow((double) N, 1.0/dim));
+	long volume = 1;
+	for (int d = 0; d < dim; ++d) volume *= L;
+	if (volume != N) throw std::runtime_error("lattice size N must be a perfect power of the lattice dimension");
+	if (2*k + 1 > L) throw std::runtime_error("lattice side must be at least 2k+1");
+
+	std::vector<int> stride(dim);
+	stride[0] = 1;
+	for (int d = 1; d < dim; ++d) stride[d] = stride[d-1] * L;
+
+	int kernelSize = 2*dim*k;
+	checkEntries((uint64_t) N * kernelSize);
+	kernelList.resize((size_t) N * kernelSize);
+	kernelId.resize(N + 1);
+	kernelId[N] = (edge_t) kernelList.size();
+	size_t idx = 0;
+	for (int i = 0; i < N; ++i) {
+		kernelId[i] = (edge_t) idx;
+		for (int d = 0; d < dim; ++d) {
+			int coord = (i / stride[d]) % L;
+			for (int j = -k; j <= k; ++j) {
+				if (j == 0) continue;
+				int shifted = coord + j;
+				if (shifted < 0) shifted += L;
+				else if (shifted >= L) shifted -= L;
+				kernelList[idx++] = i + (shifted - coord) * stride[d];
+			}
+		}
+	}
+
+	std::cout << "\nCreated " << dim << "D periodic lattice with L=" << L << " and k=" << k << "\n";
+}
+
+void Topology::createBarabasiAlbert()
+{
+	// preferential attachment with m=k edges per new vertex, starting from a complete graph of
+	// k+1 vertices. Every edge is stored twice in 'endpoints', so a uniformly chosen entry of
+	// that list is a vertex chosen proportionally to its degree. This makes each attachment
+	// O(1) and the whole construction linear in the number of edges.
+	int m = k;
+	if (N <= m + 1) throw std::runtime_error("Barabasi-Albert graph needs N > k+1");
+
+	pcg64 rng(42u, 54u);
+	seedGenerator(rng);
+
+	size_t numEdges = (size_t) m*(m + 1)/2 + (size_t) (N - m - 1) * m;
+	std::vector<std::pair<int,int> > edges;
+	edges.reserve(numEdges);
+	std::vector<int> endpoints;
+	endpoints.reserve(2*numEdges);
+	for (int v = 1; v <= m; ++v) {
+		for (int w = 0; w < v; ++w) {
+			edges.push_back(std::make_pair(v, w));
+			endpoints.push_back(v);
+			endpoints.push_back(w);
+		}
+	}
+
+	// 'lastTarget' marks vertices already chosen by the current vertex to avoid multi-edges
+	std::vector<int> lastTarget(N, -1);
+	for (int v = m + 1; v < N; ++v) {
+		// only sample from endpoints that existed before v so v cannot choose itself
+		size_t available = endpoints.size();
+		for (int i = 0; i < m; ++i) {
+			int target = endpoints[boundedRandom(rng, available)];
+			while (lastTarget[target] == v) target = endpoints[boundedRandom(rng, available)];
+			lastTarget[target] = v;
+			edges.push_back(std::make_pair(v, target));
+			endpoints.push_back(v);
+			endpoints.push_back(target);
+		}
+	}
+	buildKernels(edges);
+
+	std::cout << "\nCreated Barabasi-Albert graph with N=" << N << " and m=" << m << "\n";
+}
+
+void Topology::createRandomRegular()
+{
+	// configuration model: every vertex gets 2k stubs which are shuffled and paired. The few
+	// self-loops and multi-edges left by the pairing are removed with degree preserving edge
+	// swaps against uniformly chosen edges, which is much cheaper than rejecting whole graphs.
+	int degree = 2*k;
+	if (degree >= N) throw std::runtime_error("random regular graph needs 2k < N");
+
+	pcg64 rng(42u, 54u);
+	seedGenerator(rng);
+
+	std::vector<int> stubs((size_t) N * degree);
+	for (int i = 0; i < N; ++i)
+		std::fill(stubs.begin() + (size_t) i*degree, stubs.begin() + (size_t) (i+1)*degree, i);
+	std::shuffle(stubs.begin(), stubs.end(), rng);
+
+	size_t numEdges = stubs.size() / 2;
+	std::vector<std::pair<int,int> > edges(numEdges);
+	std::unordered_map<uint64_t, int> multiplicity;
+	multiplicity.reserve(numEdges);
+	auto key = [this](int a, int b) -> uint64_t {
+		return a < b ? (uint64_t) a * N + b : (uint64_t) b * N + a;
+	};
+	for (size_t e = 0; e < numEdges; ++e) {
+		edges[e] = std::make_pair(stubs[2*e], stubs[2*e + 1]);
+		++multiplicity[key(stubs[2*e], stubs[2*e + 1])];
+	}
+	std::vector<int>().swap(stubs);
+
+	std::vector<size_t> bad;
+	for (size_t e = 0; e < numEdges; ++e) {
+		int a = edges[e].first, b = edges[e].second;
+		if (a == b || multiplicity[key(a, b)] > 1) bad.push_back(e);
+	}
+
+	size_t attempts = 0, maxAttempts = 1000 * (bad.size() + 1);
+	while (!bad.empty()) {
+		size_t e = bad.back();
+		int a = edges[e].first, b = edges[e].second;
+		// the edge might have been fixed as a side effect of an earlier swap
+		if (a != b && multiplicity[key(a, b)] <= 1) {
+			bad.pop_back();
+			continue;
+		}
+		if (++attempts > maxAttempts) throw std::runtime_error("failed to remove multi-edges from random regular graph");
+
+		size_t f = boundedRandom(rng, numEdges);
+		if (f == e) continue;
+		int c = edges[f].first, d = edges[f].second;
+		if (boundedRandom(rng, 2)) std::swap(c, d);
+		// swap (a,b),(c,d) -> (a,c),(b,d) only if the new edges are simple and new
+		if (a == c || b == d) continue;
+		if (multiplicity.count(key(a, c)) || multiplicity.count(key(b, d)) || key(a, c) == key(b, d)) continue;
+
+		if (--multiplicity[key(a, b)] == 0) multiplicity.erase(key(a, b));
+		if (--multiplicity[key(c, d)] == 0) multiplicity.erase(key(c, d));
+		++multiplicity[key(a, c)];
+		++multiplicity[key(b, d)];
+		edges[e] = std::make_pair(a, c);
+		edges[f] = std::make_pair(b, d);
+		bad.pop_back();
+	}
+	buildKernels(edges);
+
+	std::cout << "\nCreated random regular graph with N=" << N << " and degree " << degree << "\n";
+}
+
+void Topology::buildKernels(std::vector<std::pair<int,int> > const& edges)
+{
+	buildKernels(N, edges, kernelList, kernelId);
+}
+
+void Topology::buildKernels(
+		int const N,
+		std::vector<std::pair<int,int> > const& edges,
+		large_vector<vertex_t>& kernelList,
+		large_vector<edge_t>& kernelId
+		)
+{
+	// convert an undirected edge list into the kernelList/kernelId layout with a counting
+	// sort: count the degrees, compute the kernel offsets and scatter both endpoints.
+	std::vector<int> kernelSizes(N, 0);
+	for (size_t e = 0; e < edges.size(); ++e) {
+		++kernelSizes[edges[e].first];
+		++kernelSizes[edges[e].second];
+	}
+
+	checkEntries(2 * (uint64_t) edges.size());
+	kernelId.resize(N + 1);
+	edge_t sum = 0;
+	for (int i = 0; i < N; ++i) {
+		kernelId[i] = sum;
+		sum += kernelSizes[i];
+	}
+	kernelId[N] = sum;
+
+	kernelList.resize(sum);
+	large_vector<edge_t> fill(kernelId);
+	for (size_t e = 0; e < edges.size(); ++e) {
+		int a = edges[e].first, b = edges[e].second;
+		kernelList[fill[a]++] = b;
+		kernelList[fill[b]++] = a;
+	}
+}
+
+void Topology::checkEntries(uint64_t entries)
+{
+	// the number of kernel entries (twice the number of edges) must fit the kernel offsets
+	if (entries > (uint64_t) std::numeric_limits<edge_t>::max())
+		throw std::runtime_error("graph has too many edges for 32-bit kernel offsets, build with 'make LARGE=1'");
+}
+
+void Topology::seedGenerator(pcg64& rng) const
+{
+	if(NON_DETERMINISTIC_TOPOLOGY) rng.seed(pcg_extras::seed_seq_from<std::random_device>());
 }
 
-bool Topology::isInKernel(int kernelNum, int element) const
+Topology::GraphType Topology::graphTypeFromName(std::string const& name)
 {
-	// return if element is in kernel number kernelNum
-	std::vector<int>::const_iterator start = kernelList.begin() + kernelId[kernelNum];
-	std::vector<int>::const_iterator finish = start + kernelSizes[kernelNum];
+	if (name == "ring") return RING;
+	if (name == "erdos-renyi") return ERDOS_RENYI;
+	if (name == "lattice2d") return LATTICE_2D;
+	if (name == "lattice3d") return LATTICE_3D;
+	if (name == "barabasi-albert") return BARABASI_ALBERT;
+	if (name == "random-regular") return RANDOM_REGULAR;
+	throw std::runtime_error("unknown graph type '" + name + "'");
+}
 
-	if (std::find(start, finish, element) != finish) return true;
-	return false;
+std::string Topology::graphTypeName(GraphType type)
+{
+	switch(type) {
+		case RING: return "ring";
+		case ERDOS_RENYI: return "erdos-renyi";
+		case LATTICE_2D: return "lattice2d";
+		case LATTICE_3D: return "lattice3d";
+		case BARABASI_ALBERT: return "barabasi-albert";
+		case RANDOM_REGULAR: return "random-regular";
+		case IMPORTED: return "imported";
+		default: throw std::runtime_error("invalid graph type in 'graphTypeName'");
+	}
 }
 
 void Topology::printKernel(int i) const
 {
-	int first = kernelId[i];
-	int last = first + kernelSizes[i];
-	for (int i = first; i < last; ++i) std::cout << kernelList[i] << " ";
+	edge_t first = kernelId[i];
+	edge_t last = kernelId[i + 1];
+	for (edge_t j = first; j < last; ++j) std::cout << kernelList[j] << " ";
 	std::cout << "\n";
 }
 
@@ -124,8 +746,8 @@ void Topology::printTopology() const
 	std::cout << "\n";
 	for(int i = 0; i < N; ++i) {
 		std::cout << i << " ";
-		std::vector<int>::const_iterator start = kernelList.begin() + kernelId[i];
-		std::vector<int>::const_iterator end = kernelList.begin() + kernelId[i] + kernelSizes[i];
+		large_vector<vertex_t>::const_iterator start = kernelList.begin() + kernelId[i];
+		large_vector<vertex_t>::const_iterator end = kernelList.begin() + kernelId[i + 1];
 		for (int j = 0; j < N; ++j) {
 			if (std::find(start, end, j) != end) {
 				std::cout << "* ";
@@ -152,3 +774,26 @@ void Topology::printToFile() const
 {
 	std::cout << "print to file not implemented yet\n";
 }
+
+void Topology::printMemoryPlacement() const
+{
+	::printMemoryPlacement("kernelList", kernelList.data(), kernelList.size()*sizeof(vertex_t));
+	::printMemoryPlacement("kernelId", kernelId.data(), kernelId.size()*sizeof(edge_t));
+}
+
+void Topology::saveBinary(std::string const& path) const
+{
+	std::ofstream file(path.c_str(), std::ios::binary);
+	if (!file.is_open()) throw std::runtime_error("failed to open '" + path + "' for writing");
+
+	CSRHeader header;
+	memcpy(header.magic, CSR_MAGIC, sizeof(CSR_MAGIC));
+	header.N = N;
+	header.entries = kernelList.size();
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	std::vector<uint64_t> offsets(kernelId.begin(), kernelId.end());
+	file.write(reinterpret_cast<const char*>(&offsets[0]), offsets.size() * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(&kernelList[0]), kernelList.size() * sizeof(vertex_t));
+	if (!file) throw std::runtime_error("failed to write binary graph file '" + path + "'");
+}
@@ -0,0 +1,99 @@
+"""Live view of a running simulation started with TELEMETRY=1 (see include/telemetry.hpp).
+
+    python3 telemetry.py [segment]
+
+attaches to /dev/shm/<segment>, or to the most recent event-driven-* segment, and prints its
+state at every refresh without touching the simulation's output files.
+"""
+import os
+import sys
+import time
+import mmap
+import struct
+import numpy as np
+
+MAX_STATES = 64
+HISTORY = 1024
+HEADER = struct.Struct("<8sQQQdddd8i")
+POPULATIONS = struct.Struct("<%di" % MAX_STATES)
+SIZE = HEADER.size + POPULATIONS.size + 8 * HISTORY
+PHASES = ["relaxation", "burn-in", "measurement", "finished"]
+SPARKS = " .:-=+*#%@"
+
+
+def find_segment():
+    segments = [s for s in os.listdir("/dev/shm") if s.startswith("event-driven-")]
+    if not segments:
+        raise SystemExit("no telemetry segment in /dev/shm, run the simulation with TELEMETRY=1")
+    return max(segments, key=lambda s: os.path.getmtime(os.path.join("/dev/shm", s)))
+
+
+def read_frame(data):
+    """Consistent copy of the frame: the seqlock is even and unchanged around the copy."""
+    while True:
+        before = struct.unpack_from("<Q", data, 8)[0]
+        if before % 2 == 0:
+            raw = bytes(data[:SIZE])
+            if struct.unpack_from("<Q", data, 8)[0] == before:
+                break
+        time.sleep(0.0001)
+    fields = HEADER.unpack_from(raw)
+    frame = dict(zip(["magic", "sequence", "events", "historyCount", "time", "eventsPerSecond",
+                      "r", "coupling", "pid", "N", "Q", "phase", "couplingIndex", "couplings",
+                      "trial", "trials"], fields))
+    if frame["magic"] != b"EDTEL 1\0":
+        raise SystemExit("not a telemetry segment")
+    frame["populations"] = POPULATIONS.unpack_from(raw, HEADER.size)[:frame["Q"]]
+    ring = np.frombuffer(raw, dtype="<f8", count=HISTORY, offset=HEADER.size + POPULATIONS.size)
+    count = frame["historyCount"]
+    if count <= HISTORY:
+        frame["history"] = ring[:count].copy()
+    else:
+        frame["history"] = np.roll(ring, -(count % HISTORY))
+    return frame
+
+
+def sparkline(values, width=64):
+    values = values[-width:]
+    if len(values) == 0:
+        return ""
+    low, high = values.min(), values.max()
+    scale = (len(SPARKS) - 1) / (high - low) if high > low else 0
+    return "".join(SPARKS[int((v - low) * scale)] for v in values)
+
+
+def describe(frame):
+    phase = PHASES[frame["phase"]] if frame["phase"] < len(PHASES) else "?"
+    where = "a=%.4f" % frame["coupling"]
+    if frame["couplingIndex"] >= 0:
+        where += " [%d/%d]" % (frame["couplingIndex"] + 1, frame["couplings"])
+    if frame["trial"] >= 0:
+        where += " trial %d/%d" % (frame["trial"] + 1, frame["trials"])
+    return "%-11s %s  events=%d t=%.3f  %.3g events/s  r=%.4f  N=%s  |%s|" % (
+        phase, where, frame["events"], frame["time"], frame["eventsPerSecond"], frame["r"],
+        ",".join(str(n) for n in frame["populations"]), sparkline(frame["history"]))
+
+
+def main():
+    segment = sys.argv[1] if len(sys.argv) > 1 else find_segment()
+    with open(os.path.join("/dev/shm", segment.lstrip("/")), "rb") as f:
+        data = mmap.mmap(f.fileno(), SIZE, prot=mmap.PROT_READ)
+    print("attached to /dev/shm/" + segment.lstrip("/"))
+    last = None
+    while True:
+        frame = read_frame(data)
+        if frame["sequence"] != last:
+            print(describe(frame), flush=True)
+            last = frame["sequence"]
+        if frame["phase"] == PHASES.index("finished"):
+            break
+        try:
+            os.kill(frame["pid"], 0)
+        except ProcessLookupError:
+            print("the simulation is gone")
+            break
+        time.sleep(0.5)
+
+
+if __name__ == "__main__":
+    main()
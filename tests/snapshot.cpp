@@ -0,0 +1,43 @@
+// a snapshot restored after the ring was rewired away and back, which lays the transitions table
+// out again, must continue exactly like the same snapshot restored right away
+#include <iostream>
+#include <vector>
+#include <stdexcept>
+
+#include "lattice.hpp"
+
+namespace {
+
+std::vector<int> events(Lattice& lattice, int count)
+{
+	std::vector<int> sequence(count);
+	for (int i = 0; i < count; ++i) {
+		lattice.step();
+		sequence[i] = lattice.getLastEvent();
+	}
+	return sequence;
+}
+
+}
+
+int main()
+{
+	try {
+		pcg64 rng(42u, 54u);
+		Lattice lattice(3000, 5, 0.05, false, 2.0, rng);
+		events(lattice, 10000);
+		Lattice::Snapshot relaxed = lattice.snapshot();
+		std::vector<int> expected = events(lattice, 100000);
+
+		lattice.setRewireProbability(0.5);
+		events(lattice, 1000);
+		lattice.setRewireProbability(0.05);
+		lattice.restore(relaxed);
+		if (events(lattice, 100000) != expected) throw std::runtime_error("restored trajectory differs");
+	} catch (std::exception const& e) {
+		std::cerr << "FAILED " << e.what() << "\n";
+		return 1;
+	}
+	std::cout << "snapshot: passed\n";
+	return 0;
+}